@@ -0,0 +1,77 @@
+#include "assets.h"
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+
+namespace Assets {
+	struct Job {
+		const char * path;
+		Mesh * target;
+		UploadFn upload;
+		bool ok;
+	};
+
+	std::vector< Job > jobs;
+	std::atomic< size_t > nextJob(0);
+	std::vector< std::thread > workers;
+
+	std::mutex finishedMutex;
+	std::vector< size_t > finished;
+	int pending = 0;
+
+	void worker() {
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+			jobs[i].ok = loadMesh(jobs[i].path, *jobs[i].target);
+			if (!jobs[i].ok) {
+				printf("Could not load %s\n", jobs[i].path);
+			}
+			std::lock_guard< std::mutex > lock(finishedMutex);
+			finished.push_back(i);
+		}
+	}
+
+	void queueMesh(const char * path, Mesh * target, UploadFn upload) {
+		Job job = { path, target, upload, false };
+		jobs.push_back(job);
+		pending++;
+	}
+
+	void startLoading() {
+		unsigned int threads = std::thread::hardware_concurrency();
+		if (threads == 0) threads = 1;
+		for (size_t i = 0; i < threads && i < jobs.size(); i++) {
+			workers.push_back(std::thread(worker));
+		}
+	}
+
+	int uploadLoaded() {
+		std::vector< size_t > ready;
+		{
+			std::lock_guard< std::mutex > lock(finishedMutex);
+			ready.swap(finished);
+		}
+		for (size_t i = 0; i < ready.size(); i++) {
+			const Job & job = jobs[ready[i]];
+			if (job.ok && job.upload != NULL) {
+				job.upload();
+			}
+			pending--;
+		}
+		return pending;
+	}
+
+	void shutdown() {
+		// Jobs already handed out still finish; the rest are skipped
+		nextJob = jobs.size();
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+		workers.clear();
+		jobs.clear();
+		finished.clear();
+		pending = 0;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "meshcache.h"
+
+// Background mesh loading. Worker threads run loadMesh (file I/O, parsing, cache
+// rebuilds) and hand each finished mesh back to the GL thread, which creates the
+// GPU objects from uploadLoaded once per frame.
+namespace Assets {
+	typedef void(*UploadFn)();
+
+	// Registers a mesh to load into target. upload runs on the GL thread once it is ready.
+	void queueMesh(const char * path, Mesh * target, UploadFn upload);
+	void startLoading();
+	// Runs the upload callback of every mesh finished since the last call.
+	// Returns the number of meshes still loading.
+	int uploadLoaded();
+	void shutdown();
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "bench.h"
+#include "filemap.h"
+#include "objloader.h"
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	double secondsSince(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	typedef bool(*LoadFn)(const char *, std::vector< glm::vec3 > &, std::vector< glm::vec2 > &, std::vector< glm::vec3 > &);
+
+	// Runs the loader until at least a second has passed (and at least 3 times), returns seconds per load
+	double timeLoader(LoadFn load, const char * path) {
+		int iterations = 0;
+		Clock::time_point start = Clock::now();
+		do {
+			std::vector< glm::vec3 > vertices, normals;
+			std::vector< glm::vec2 > uvs;
+			if (!load(path, vertices, uvs, normals)) return -1.0;
+			iterations++;
+		} while (iterations < 3 || secondsSince(start) < 1.0);
+		return secondsSince(start) / iterations;
+	}
+
+	double timeParse(const MappedFile & file, unsigned int threads, ObjData & out) {
+		int iterations = 0;
+		Clock::time_point start = Clock::now();
+		do {
+			if (!parseOBJ(file.data, file.size, out, threads)) return -1.0;
+			iterations++;
+		} while (iterations < 3 || secondsSince(start) < 1.0);
+		return secondsSince(start) / iterations;
+	}
+
+	bool sameObj(const ObjData & a, const ObjData & b) {
+		return a.vertices == b.vertices && a.uvs == b.uvs && a.normals == b.normals && a.faces == b.faces;
+	}
+
+	// --bench-switch: after the warm up, one switch every switchInterval frames
+	const int switchWarmupFrames = 60;
+	const int switchInterval = 30;
+	const int switchCount = 20;
+	int switchFrames = 0;
+	int switches = 0;
+	bool switchPending = false;
+	std::vector< double > steadyTimes, switchTimes;
+
+	// --bench-gondolas: every count on every path, warm up frames first
+	const int gondolaCounts[] = { 20, 100, 500, 1000, 5000, 10000, 20000 };
+	const int gondolaCountCount = sizeof(gondolaCounts) / sizeof(gondolaCounts[0]);
+	const int gondolaPaths = 3;	// per draw, instanced, multi-draw indirect
+	const int gondolaWarmupFrames = 10;
+	const int gondolaFrames = 60;
+	int gondolaConfig = 0;
+	int gondolaFrame = 0;
+	double gondolaSum = 0.0;
+	double gondolaTimes[gondolaCountCount][gondolaPaths];
+
+	double median(std::vector< double > times) {
+		std::sort(times.begin(), times.end());
+		return times.empty() ? 0.0 : times[times.size() / 2];
+	}
+	double maximum(const std::vector< double > & times) {
+		return times.empty() ? 0.0 : *std::max_element(times.begin(), times.end());
+	}
+}
+
+int benchOBJ(const char * path)
+{
+	MappedFile file;
+	if (!mapFile(path, file)) {
+		printf("Impossible to open the file !\n");
+		return 1;
+	}
+	double megabytes = file.size / (1024.0 * 1024.0);
+
+	std::vector< glm::vec3 > refVertices, refNormals, vertices, normals;
+	std::vector< glm::vec2 > refUvs, uvs;
+	if (!loadOBJLegacy(path, refVertices, refUvs, refNormals) || !loadOBJ(path, vertices, uvs, normals)) {
+		unmapFile(file);
+		return 1;
+	}
+	bool same = refVertices == vertices && refUvs == uvs && refNormals == normals;
+
+	double legacy = timeLoader(loadOBJLegacy, path);
+	double mapped = timeLoader(loadOBJ, path);
+
+	printf("%s: %.2f MB, %u triangles\n", path, megabytes, (unsigned int)(vertices.size() / 3));
+	printf("  fscanf loader : %8.2f ms  %8.1f MB/s\n", legacy * 1e3, megabytes / legacy);
+	printf("  mapped loader : %8.2f ms  %8.1f MB/s  (x%.1f)\n", mapped * 1e3, megabytes / mapped, legacy / mapped);
+	printf("  output %s\n", same ? "matches" : "DIFFERS from the fscanf loader");
+
+	// Parse only (no expansion), serial against the chunked parallel mode
+	ObjData serial, parallel;
+	double single = timeParse(file, 1, serial);
+	printf("  parse  1 thread  : %8.2f ms  %8.1f MB/s\n", single * 1e3, megabytes / single);
+	unsigned int cores = std::thread::hardware_concurrency();
+	for (unsigned int threads = 2; single > 0.0 && threads <= cores; threads *= 2) {
+		double t = timeParse(file, threads, parallel);
+		bool match = sameObj(serial, parallel);
+		printf("  parse %2u threads : %8.2f ms  %8.1f MB/s  (x%.1f)%s\n", threads, t * 1e3, megabytes / t, single / t, match ? "" : "  DIFFERS from serial");
+		same = same && match;
+	}
+	unmapFile(file);
+	return same ? 0 : 1;
+}
+
+int benchSwitchFrame(double frameSeconds, bool sceneLoaded)
+{
+	if (!sceneLoaded || switchFrames++ < switchWarmupFrames) {
+		return 0;
+	}
+	// The switch requested after a frame is applied by the next one
+	if (switchPending) switchTimes.push_back(frameSeconds);
+	else steadyTimes.push_back(frameSeconds);
+	switchPending = false;
+
+	if (switches == switchCount) {
+		double steady = median(steadyTimes);
+		printf("Exercise switches: %d, %d frames in between\n", switches, (int)steadyTimes.size());
+		printf("  steady frames : median %8.2f ms  max %8.2f ms\n", steady * 1e3, maximum(steadyTimes) * 1e3);
+		printf("  switch frames : median %8.2f ms  max %8.2f ms  (x%.1f the steady median)\n", median(switchTimes) * 1e3, maximum(switchTimes) * 1e3,
+			steady > 0.0 ? maximum(switchTimes) / steady : 0.0);
+		return -1;
+	}
+	if ((switchFrames - switchWarmupFrames) % switchInterval == 0) {
+		switchPending = true;
+		switches++;
+		// The scene starts in exercise 1
+		return switches % 2 == 1 ? 2 : 1;
+	}
+	return 0;
+}
+
+bool benchGondolasFrame(double submitSeconds, bool sceneReady, bool multiDraw, int & count, int & path)
+{
+	// Multi-draw columns are skipped without GL 4.3
+	if (!multiDraw && gondolaConfig % gondolaPaths == 2) gondolaConfig++;
+	if (sceneReady && gondolaConfig < gondolaCountCount * gondolaPaths) {
+		if (gondolaFrame >= gondolaWarmupFrames) gondolaSum += submitSeconds;
+		if (++gondolaFrame == gondolaWarmupFrames + gondolaFrames) {
+			gondolaTimes[gondolaConfig / gondolaPaths][gondolaConfig % gondolaPaths] = gondolaSum / gondolaFrames;
+			gondolaSum = 0.0;
+			gondolaFrame = 0;
+			gondolaConfig++;
+			if (!multiDraw && gondolaConfig % gondolaPaths == 2) gondolaConfig++;
+		}
+	}
+	if (gondolaConfig == gondolaCountCount * gondolaPaths) {
+		printf("Gondola submit, CPU ms per frame (%d frames each)\n", gondolaFrames);
+		printf("   count   per draw  instanced  multi-draw\n");
+		for (int i = 0; i < gondolaCountCount; i++) {
+			printf("  %6d  %9.3f  %9.3f", gondolaCounts[i], gondolaTimes[i][0] * 1e3, gondolaTimes[i][1] * 1e3);
+			if (multiDraw) printf("  %10.3f\n", gondolaTimes[i][2] * 1e3);
+			else printf("         n/a\n");
+		}
+		return false;
+	}
+	count = gondolaCounts[gondolaConfig / gondolaPaths];
+	path = gondolaConfig % gondolaPaths;
+	return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Offline benchmarks, selected from the command line before any window is created.
+// Each one prints its report to stdout and returns the process exit code.
+int benchOBJ(const char * path);
+
+// Frame time spike around exercise switches (--bench-switch), driven by the normal main loop.
+// It reports every frame's duration, measured after glFinish, and gets back the exercise to
+// request before the next frame (0 for none), or -1 once the report has been printed.
+int benchSwitchFrame(double frameSeconds, bool sceneLoaded);
+
+// CPU cost of submitting the gondolas (--bench-gondolas): sweeps the gondola count on each
+// submit path (per draw, instanced, and multi-draw indirect when multiDraw is supported) and
+// reports the average time GLrender spent placing, queueing and submitting them. Called after
+// every frame with that time, it sets the count and path the next frame uses, and returns
+// false once the report has been printed.
+bool benchGondolasFrame(double submitSeconds, bool sceneReady, bool multiDraw, int & count, int & path);
@@ -0,0 +1,142 @@
+#include <cfloat>
+
+#include "culling.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE
+#endif
+
+
+Frustum extractFrustum(const glm::mat4 & clipFromSpace)
+{
+	// Gribb and Hartmann: rows of the matrix combined with the w row
+	glm::mat4 m = glm::transpose(clipFromSpace);
+	Frustum frustum;
+	frustum.planes[0] = m[3] + m[0];
+	frustum.planes[1] = m[3] - m[0];
+	frustum.planes[2] = m[3] + m[1];
+	frustum.planes[3] = m[3] - m[1];
+	frustum.planes[4] = m[3] + m[2];
+	frustum.planes[5] = m[3] - m[2];
+	for (int i = 0; i < 6; i++) {
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	}
+	return frustum;
+}
+
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius)
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius) return false;
+	}
+	return true;
+}
+
+void clearSpheres(SphereSet & spheres)
+{
+	spheres.x.clear();
+	spheres.y.clear();
+	spheres.z.clear();
+	spheres.radius.clear();
+	spheres.count = 0;
+}
+
+void addSphere(SphereSet & spheres, const glm::vec3 & center, float radius)
+{
+	// The padding is a sphere no plane can see, overwritten by the next ones added
+	if (spheres.count == spheres.x.size()) {
+		size_t padded = spheres.count + 8;
+		spheres.x.resize(padded, 0.f);
+		spheres.y.resize(padded, 0.f);
+		spheres.z.resize(padded, 0.f);
+		spheres.radius.resize(padded, -FLT_MAX);
+	}
+	spheres.x[spheres.count] = center.x;
+	spheres.y[spheres.count] = center.y;
+	spheres.z[spheres.count] = center.z;
+	spheres.radius[spheres.count] = radius;
+	spheres.count++;
+}
+
+int cullSpheres(const Frustum & frustum, const SphereSet & spheres, std::vector< unsigned char > & visible)
+{
+	visible.resize(spheres.count);
+	int visibleCount = 0;
+	size_t i = 0;
+
+#if defined(CULL_AVX)
+	__m256 planes[6][4];
+	for (int p = 0; p < 6; p++) {
+		for (int c = 0; c < 4; c++) planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+	}
+	for (; i < spheres.count; i += 8) {
+		__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)), _mm256_add_ps(_mm256_mul_ps(planes[p][2], z), planes[p][3]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		size_t lanes = spheres.count - i < 8 ? spheres.count - i : 8;
+		for (size_t lane = 0; lane < lanes; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#elif defined(CULL_SSE)
+	__m128 planes[6][4];
+	for (int p = 0; p < 6; p++) {
+		for (int c = 0; c < 4; c++) planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+	}
+	for (; i < spheres.count; i += 4) {
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)), _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		int mask = _mm_movemask_ps(inside);
+		size_t lanes = spheres.count - i < 4 ? spheres.count - i : 4;
+		for (size_t lane = 0; lane < lanes; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#else
+	for (; i < spheres.count; i++) {
+		visible[i] = sphereInFrustum(frustum, glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]);
+		visibleCount += visible[i];
+	}
+#endif
+
+	return visibleCount;
+}
+
+const char * cullSpheresKernel()
+{
+#if defined(CULL_AVX)
+	return "AVX";
+#elif defined(CULL_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+bool meshletBackfacing(const Meshlet & meshlet, const glm::vec3 & cameraPosition)
+{
+	glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+	glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+	glm::vec3 toCenter = center - cameraPosition;
+	return glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
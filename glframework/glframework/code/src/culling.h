@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <glm\gtc\type_ptr.hpp>
+#include <glm\gtc\matrix_transform.hpp>
+
+#include "meshopt.h"
+
+// Frustum planes (left, right, bottom, top, near, far) with normalised xyz pointing inwards,
+// in whatever space the matrix they were extracted from maps to clip space
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4 & clipFromSpace);
+
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius);
+
+// Bounding spheres stored as one array per component, so cullSpheres tests 8 (AVX) or 4
+// (SSE) of them against a plane per instruction. The arrays are padded to a multiple of 8.
+struct SphereSet {
+	std::vector< float > x, y, z, radius;
+	size_t count;
+};
+
+void clearSpheres(SphereSet & spheres);
+void addSphere(SphereSet & spheres, const glm::vec3 & center, float radius);
+
+// sphereInFrustum for the whole set: visible gets a 1 or 0 per sphere, returns the 1s
+int cullSpheres(const Frustum & frustum, const SphereSet & spheres, std::vector< unsigned char > & visible);
+
+// "AVX", "SSE" or "scalar", whichever cullSpheres was built with
+const char * cullSpheresKernel();
+
+// True when no triangle of the meshlet faces a camera placed at cameraPosition
+bool meshletBackfacing(const Meshlet & meshlet, const glm::vec3 & cameraPosition);
@@ -0,0 +1,141 @@
+#include "filemap.h"
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+
+bool mapFile(const char * path, MappedFile & out)
+{
+	out.data = NULL;
+	out.size = 0;
+	out.handle = NULL;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	if (size.QuadPart == 0) {
+		// Nothing to map, an empty view is still a valid file
+		CloseHandle(file);
+		return true;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		return false;
+	}
+	void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+	out.data = (const char *)view;
+	out.size = (size_t)size.QuadPart;
+	out.handle = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return true;
+	}
+	void * view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+	out.data = (const char *)view;
+	out.size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+void unmapFile(MappedFile & file)
+{
+	if (file.data != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(file.data);
+		CloseHandle((HANDLE)file.handle);
+#else
+		munmap((void *)file.data, file.size);
+#endif
+	}
+	file.data = NULL;
+	file.size = 0;
+	file.handle = NULL;
+}
+
+bool statFile(const char * path, unsigned long long & size, long long & modified)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) {
+		return false;
+	}
+	size = (unsigned long long)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+	modified = (long long)((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime);
+#else
+	struct stat info;
+	if (stat(path, &info) != 0) {
+		return false;
+	}
+	size = (unsigned long long)info.st_size;
+	modified = (long long)info.st_mtime;
+#endif
+	return true;
+}
+
+bool writeFileAtomic(const char * path, const void * data, size_t size)
+{
+	std::string tmp = std::string(path) + ".tmp";
+	FILE * file = fopen(tmp.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok = fclose(file) == 0 && ok;
+	if (ok) {
+#ifdef _WIN32
+		ok = MoveFileExA(tmp.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		ok = rename(tmp.c_str(), path) == 0;
+#endif
+	}
+	if (!ok) {
+		remove(tmp.c_str());
+	}
+	return ok;
+}
+
+bool makeDirectory(const char * path)
+{
+#ifdef _WIN32
+	return CreateDirectoryA(path, NULL) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+
+// Read-only view of a whole file mapped into memory.
+struct MappedFile {
+	const char * data;
+	size_t size;
+	void * handle;
+};
+
+bool mapFile(const char * path, MappedFile & out);
+void unmapFile(MappedFile & file);
+
+// Size and last write time of path without opening it. The time is in the platform's own
+// units, only meant to be compared with another statFile on the same machine.
+bool statFile(const char * path, unsigned long long & size, long long & modified);
+
+// Writes the whole buffer to a temporary file and renames it over path, so readers
+// never observe (or map) a half written file.
+bool writeFileAtomic(const char * path, const void * data, size_t size);
+
+// Creates the directory if it does not exist yet
+bool makeDirectory(const char * path);
@@ -0,0 +1,89 @@
+#include "filewatch.h"
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <limits.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+	struct WatchedFile {
+		std::string path;
+#ifdef __linux__
+		std::string name;	// as inotify reports it, relative to the directory
+		int watch;
+#else
+		long long modified;
+#endif
+	};
+	std::vector< WatchedFile > watched;
+
+#ifdef __linux__
+	int notify = -1;
+#else
+	long long modifiedTime(const char * path) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path, &info) != 0) return -1;
+#else
+		struct stat info;
+		if (stat(path, &info) != 0) return -1;
+#endif
+		return (long long)info.st_mtime;
+	}
+#endif
+}
+
+void watchFile(const char * path)
+{
+	for (size_t i = 0; i < watched.size(); i++) {
+		if (watched[i].path == path) {
+			return;
+		}
+	}
+	WatchedFile file;
+	file.path = path;
+#ifdef __linux__
+	if (notify < 0) notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notify < 0) return;
+	size_t slash = file.path.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "." : file.path.substr(0, slash);
+	file.name = slash == std::string::npos ? file.path : file.path.substr(slash + 1);
+	// Watches are per directory, adding the same one twice returns the same descriptor
+	file.watch = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (file.watch < 0) return;
+#else
+	file.modified = modifiedTime(path);
+#endif
+	watched.push_back(file);
+}
+
+void pollChangedFiles(std::vector< std::string > & changed)
+{
+#ifdef __linux__
+	if (notify < 0) return;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+	while ((length = read(notify, buffer, sizeof(buffer))) > 0) {
+		for (char * p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			const struct inotify_event * event = (const struct inotify_event *)p;
+			if (event->len == 0) continue;
+			for (size_t i = 0; i < watched.size(); i++) {
+				if (watched[i].watch == event->wd && watched[i].name == event->name) changed.push_back(watched[i].path);
+			}
+		}
+	}
+#else
+	for (size_t i = 0; i < watched.size(); i++) {
+		long long modified = modifiedTime(watched[i].path.c_str());
+		// A missing file is usually an editor halfway through saving, wait for it to come back
+		if (modified < 0 || modified == watched[i].modified) continue;
+		watched[i].modified = modified;
+		changed.push_back(watched[i].path);
+	}
+#endif
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Change notifications for a handful of files, polled from the render loop without ever
+// blocking. inotify on Linux (watching the parent directory, so editors that save by
+// renaming a new file over the old one are seen too), modification times elsewhere.
+void watchFile(const char * path);
+// Appends the watched paths written since the last call
+void pollChangedFiles(std::vector< std::string > & changed);
@@ -0,0 +1,269 @@
+#include <stddef.h>
+#include <vector>
+
+#include "geometryarena.h"
+#include "glstate.h"
+
+namespace {
+	const size_t initialVertexCapacity = 1 << 18;	// 4 MB of PackedVertex
+	const size_t initialIndexCapacity = 1 << 22;	// in bytes
+	const size_t indexAlignment = 4;	// so 32 bit meshes stay aligned after 16 bit ones
+
+	struct Range {
+		size_t offset, size;
+	};
+
+	// First fit over [0, capacity). Free ranges are sorted by offset and merged with their
+	// neighbours on release, so the last one always ends at capacity when not full.
+	struct RangeAllocator {
+		size_t capacity;
+		size_t used;
+		std::vector< Range > free;
+	};
+
+	void resetRanges(RangeAllocator & allocator, size_t capacity, size_t used) {
+		allocator.capacity = capacity;
+		allocator.used = used;
+		allocator.free.clear();
+		if (used < capacity) {
+			Range rest = { used, capacity - used };
+			allocator.free.push_back(rest);
+		}
+	}
+
+	bool allocateRange(RangeAllocator & allocator, size_t size, size_t & offset) {
+		for (size_t i = 0; i < allocator.free.size(); i++) {
+			Range & range = allocator.free[i];
+			if (range.size < size) continue;
+			offset = range.offset;
+			range.offset += size;
+			range.size -= size;
+			if (range.size == 0) allocator.free.erase(allocator.free.begin() + i);
+			allocator.used += size;
+			return true;
+		}
+		return false;
+	}
+
+	void releaseRange(RangeAllocator & allocator, size_t offset, size_t size) {
+		allocator.used -= size;
+		size_t i = 0;
+		while (i < allocator.free.size() && allocator.free[i].offset < offset) i++;
+		bool joinsPrevious = i > 0 && allocator.free[i - 1].offset + allocator.free[i - 1].size == offset;
+		bool joinsNext = i < allocator.free.size() && offset + size == allocator.free[i].offset;
+		if (joinsPrevious && joinsNext) {
+			allocator.free[i - 1].size += size + allocator.free[i].size;
+			allocator.free.erase(allocator.free.begin() + i);
+		}
+		else if (joinsPrevious) allocator.free[i - 1].size += size;
+		else if (joinsNext) {
+			allocator.free[i].offset = offset;
+			allocator.free[i].size += size;
+		}
+		else {
+			Range range = { offset, size };
+			allocator.free.insert(allocator.free.begin() + i, range);
+		}
+	}
+
+	// Free space of the allocator that is not its tail
+	int holes(const RangeAllocator & allocator) {
+		int count = (int)allocator.free.size();
+		if (count > 0 && allocator.free.back().offset + allocator.free.back().size == allocator.capacity) count--;
+		return count;
+	}
+
+	struct Allocation {
+		size_t vertexOffset, vertexCount;	// in vertices
+		size_t indexOffset, indexBytes;
+		bool live;
+	};
+
+	GLuint vertexBuffer, indexBuffer;
+	RangeAllocator vertices, indices;
+	std::vector< Allocation > allocations;	// by handle - 1
+	std::vector< GLuint > vertexArrays;	// the shared one first
+	int relocations;
+
+	size_t alignIndices(size_t bytes) {
+		return (bytes + indexAlignment - 1) / indexAlignment * indexAlignment;
+	}
+
+	// Binds the interleaved PackedVertex layout of the arena to vao
+	void setupVertexLayout(GLuint vao) {
+		GLState::bindVertexArray(vao);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glVertexAttribPointer((GLuint)0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer((GLuint)1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer((GLuint)2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, uv));
+		glEnableVertexAttribArray(2);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLuint createBuffer(size_t size) {
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+		return buffer;
+	}
+
+	// Copies the live allocations back to back into new buffers of the given capacities and
+	// points every VAO at them. Both defragmenting and growing go through here.
+	void relocate(size_t vertexCapacity, size_t indexCapacity) {
+		GLuint newVertexBuffer = createBuffer(vertexCapacity * sizeof(PackedVertex));
+		GLuint newIndexBuffer = createBuffer(indexCapacity);
+
+		size_t vertexEnd = 0;
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+		for (size_t i = 0; i < allocations.size(); i++) {
+			Allocation & allocation = allocations[i];
+			if (!allocation.live || allocation.vertexCount == 0) continue;
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.vertexOffset * sizeof(PackedVertex), vertexEnd * sizeof(PackedVertex), allocation.vertexCount * sizeof(PackedVertex));
+			allocation.vertexOffset = vertexEnd;
+			vertexEnd += allocation.vertexCount;
+		}
+
+		size_t indexEnd = 0;
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+		for (size_t i = 0; i < allocations.size(); i++) {
+			Allocation & allocation = allocations[i];
+			if (!allocation.live || allocation.indexBytes == 0) continue;
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexEnd, allocation.indexBytes);
+			allocation.indexOffset = indexEnd;
+			indexEnd += allocation.indexBytes;
+		}
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		GLuint oldBuffers[] = { vertexBuffer, indexBuffer };
+		vertexBuffer = newVertexBuffer;
+		indexBuffer = newIndexBuffer;
+		for (size_t i = 0; i < vertexArrays.size(); i++) setupVertexLayout(vertexArrays[i]);
+		GLState::deleteBuffers(2, oldBuffers);
+
+		resetRanges(vertices, vertexCapacity, vertexEnd);
+		resetRanges(indices, indexCapacity, indexEnd);
+		relocations++;
+	}
+
+	// Both ranges or neither
+	bool allocateBoth(Allocation & allocation) {
+		if (!allocateRange(vertices, allocation.vertexCount, allocation.vertexOffset)) return false;
+		if (!allocateRange(indices, allocation.indexBytes, allocation.indexOffset)) {
+			releaseRange(vertices, allocation.vertexOffset, allocation.vertexCount);
+			return false;
+		}
+		return true;
+	}
+}
+
+namespace GeometryArena {
+	void setup() {
+		vertexBuffer = createBuffer(initialVertexCapacity * sizeof(PackedVertex));
+		indexBuffer = createBuffer(initialIndexCapacity);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		resetRanges(vertices, initialVertexCapacity, 0);
+		resetRanges(indices, initialIndexCapacity, 0);
+		allocations.clear();
+		relocations = 0;
+		vertexArrays.clear();
+		createVertexArray();
+	}
+
+	void cleanup() {
+		for (size_t i = 0; i < vertexArrays.size(); i++) GLState::deleteVertexArrays(1, &vertexArrays[i]);
+		vertexArrays.clear();
+		GLuint buffers[] = { vertexBuffer, indexBuffer };
+		GLState::deleteBuffers(2, buffers);
+		vertexBuffer = indexBuffer = 0;
+		allocations.clear();
+	}
+
+	unsigned int allocate(const Mesh & mesh) {
+		Allocation allocation;
+		allocation.vertexCount = mesh.vertexCount;
+		allocation.indexBytes = alignIndices((size_t)mesh.indexCount * mesh.indexSize);
+		allocation.live = true;
+
+		if (!allocateBoth(allocation)) {
+			// Compacting is enough when the free space only needs joining, otherwise grow
+			size_t vertexCapacity = vertices.capacity, indexCapacity = indices.capacity;
+			while (vertexCapacity - vertices.used < allocation.vertexCount) vertexCapacity *= 2;
+			while (indexCapacity - indices.used < allocation.indexBytes) indexCapacity *= 2;
+			relocate(vertexCapacity, indexCapacity);
+			allocateBoth(allocation);
+		}
+
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertexOffset * sizeof(PackedVertex), mesh.vertexCount * sizeof(PackedVertex), mesh.vertices);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, (size_t)mesh.indexCount * mesh.indexSize, mesh.indices);
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		size_t slot = 0;
+		while (slot < allocations.size() && allocations[slot].live) slot++;
+		if (slot == allocations.size()) allocations.push_back(allocation);
+		else allocations[slot] = allocation;
+		return (unsigned int)slot + 1;
+	}
+
+	void release(unsigned int handle) {
+		Allocation & allocation = allocations[handle - 1];
+		releaseRange(vertices, allocation.vertexOffset, allocation.vertexCount);
+		releaseRange(indices, allocation.indexOffset, allocation.indexBytes);
+		allocation.live = false;
+	}
+
+	GLint baseVertex(unsigned int handle) {
+		return (GLint)allocations[handle - 1].vertexOffset;
+	}
+
+	size_t indexOffset(unsigned int handle) {
+		return allocations[handle - 1].indexOffset;
+	}
+
+	GLuint vertexArray() {
+		return vertexArrays[0];
+	}
+
+	GLuint createVertexArray() {
+		GLuint vao;
+		glGenVertexArrays(1, &vao);
+		setupVertexLayout(vao);
+		vertexArrays.push_back(vao);
+		return vao;
+	}
+
+	void deleteVertexArray(GLuint vao) {
+		for (size_t i = 1; i < vertexArrays.size(); i++) {
+			if (vertexArrays[i] != vao) continue;
+			GLState::deleteVertexArrays(1, &vao);
+			vertexArrays.erase(vertexArrays.begin() + i);
+			return;
+		}
+	}
+
+	void defragment() {
+		if (holes(vertices) + holes(indices) > 0) relocate(vertices.capacity, indices.capacity);
+	}
+
+	Stats getStats() {
+		Stats stats;
+		stats.vertexCapacity = vertices.capacity;
+		stats.verticesUsed = vertices.used;
+		stats.indexCapacity = indices.capacity;
+		stats.indicesUsed = indices.used;
+		stats.allocations = 0;
+		for (size_t i = 0; i < allocations.size(); i++) stats.allocations += allocations[i].live;
+		stats.freeRanges = holes(vertices) + holes(indices);
+		stats.relocations = relocations;
+		return stats;
+	}
+}
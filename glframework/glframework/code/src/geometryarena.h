@@ -0,0 +1,41 @@
+#pragma once
+#include <GL\glew.h>
+
+#include "meshcache.h"
+
+// Every mesh lives in one vertex buffer of PackedVertex and one index buffer, drawn from a
+// single VAO with glDrawElementsBaseVertex. Meshes keep their own 16 or 32 bit indices,
+// relative to their first vertex. Allocations are handles rather than offsets because
+// defragmenting or growing moves them; read the offsets back when drawing.
+namespace GeometryArena {
+	void setup();
+	void cleanup();
+
+	// Uploads the vertices and indices of mesh, returns its handle, never 0
+	unsigned int allocate(const Mesh & mesh);
+	void release(unsigned int handle);
+
+	// Base vertex and byte offset into the index buffer of an allocation
+	GLint baseVertex(unsigned int handle);
+	size_t indexOffset(unsigned int handle);
+
+	// VAO with the PackedVertex layout and the arena index buffer
+	GLuint vertexArray();
+	// Another VAO on the arena buffers, for draws that need more attributes. Kept pointing
+	// at the arena when it reallocates, until deleteVertexArray.
+	GLuint createVertexArray();
+	void deleteVertexArray(GLuint vao);
+
+	// Moves the live allocations together, leaving all free space at the end. allocate does
+	// this by itself when the free space is enough but split.
+	void defragment();
+
+	struct Stats {
+		size_t vertexCapacity, verticesUsed;	// in vertices
+		size_t indexCapacity, indicesUsed;	// in bytes
+		int allocations;
+		int freeRanges;	// holes between allocations, vertex and index buffers together
+		int relocations;	// defragmentations and growths so far
+	};
+	Stats getStats();
+}
@@ -0,0 +1,140 @@
+#include "glstate.h"
+
+namespace {
+	const GLuint unknown = 0xFFFFFFFF;
+	const int textureUnits = 16;
+
+	// Buffer targets with a cached binding, the rest go straight through
+	const GLenum bufferTargets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_SHADER_STORAGE_BUFFER };
+	const int bufferTargetCount = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+	const GLenum capabilities[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_PRIMITIVE_RESTART };
+	const int capabilityCount = sizeof(capabilities) / sizeof(capabilities[0]);
+
+	GLuint program = unknown;
+	GLuint vao = unknown;
+	GLuint buffers[bufferTargetCount];
+	GLuint activeUnit = unknown;
+	GLuint textures[textureUnits];	// GL_TEXTURE_2D only
+	GLuint enabled[capabilityCount];	// 0, 1 or unknown
+
+	GLState::Counters counters;
+
+	int bufferSlot(GLenum target) {
+		for (int i = 0; i < bufferTargetCount; i++) {
+			if (bufferTargets[i] == target) return i;
+		}
+		return -1;
+	}
+	int capabilitySlot(GLenum capability) {
+		for (int i = 0; i < capabilityCount; i++) {
+			if (capabilities[i] == capability) return i;
+		}
+		return -1;
+	}
+
+	// True when the call has to be issued, updating the shadow value
+	bool change(GLuint & current, GLuint value) {
+		if (current == value) {
+			counters.elided++;
+			return false;
+		}
+		current = value;
+		counters.issued++;
+		return true;
+	}
+}
+
+namespace GLState {
+	void useProgram(GLuint id) {
+		if (change(program, id)) glUseProgram(id);
+	}
+
+	void bindVertexArray(GLuint id) {
+		if (!change(vao, id)) return;
+		glBindVertexArray(id);
+		// The element buffer binding belongs to the VAO
+		buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer) {
+		int slot = bufferSlot(target);
+		if (slot < 0) {
+			counters.issued++;
+			glBindBuffer(target, buffer);
+		}
+		else if (change(buffers[slot], buffer)) glBindBuffer(target, buffer);
+	}
+
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+		// Indexed binds also set the generic binding of the target
+		counters.issued++;
+		glBindBufferBase(target, index, buffer);
+		int slot = bufferSlot(target);
+		if (slot >= 0) buffers[slot] = buffer;
+	}
+
+	void activeTexture(GLenum unit) {
+		if (change(activeUnit, unit)) glActiveTexture(unit);
+	}
+
+	void bindTexture(GLenum target, GLuint texture) {
+		GLuint unit = activeUnit == unknown ? unknown : activeUnit - GL_TEXTURE0;
+		if (target != GL_TEXTURE_2D || unit >= (GLuint)textureUnits) {
+			counters.issued++;
+			glBindTexture(target, texture);
+		}
+		else if (change(textures[unit], texture)) glBindTexture(target, texture);
+	}
+
+	void enable(GLenum capability) {
+		int slot = capabilitySlot(capability);
+		if (slot < 0) {
+			counters.issued++;
+			glEnable(capability);
+		}
+		else if (change(enabled[slot], 1)) glEnable(capability);
+	}
+
+	void disable(GLenum capability) {
+		int slot = capabilitySlot(capability);
+		if (slot < 0) {
+			counters.issued++;
+			glDisable(capability);
+		}
+		else if (change(enabled[slot], 0)) glDisable(capability);
+	}
+
+	void deleteBuffers(GLsizei count, const GLuint * ids) {
+		for (GLsizei i = 0; i < count; i++) {
+			for (int slot = 0; slot < bufferTargetCount; slot++) {
+				if (buffers[slot] == ids[i]) buffers[slot] = 0;
+			}
+		}
+		glDeleteBuffers(count, ids);
+	}
+
+	void deleteVertexArrays(GLsizei count, const GLuint * ids) {
+		for (GLsizei i = 0; i < count; i++) {
+			if (vao == ids[i]) {
+				vao = 0;
+				buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+			}
+		}
+		glDeleteVertexArrays(count, ids);
+	}
+
+	void invalidate() {
+		program = unknown;
+		vao = unknown;
+		activeUnit = unknown;
+		for (int i = 0; i < bufferTargetCount; i++) buffers[i] = unknown;
+		for (int i = 0; i < textureUnits; i++) textures[i] = unknown;
+		for (int i = 0; i < capabilityCount; i++) enabled[i] = unknown;
+	}
+
+	Counters beginFrame() {
+		Counters frame = counters;
+		counters.issued = counters.elided = 0;
+		return frame;
+	}
+}
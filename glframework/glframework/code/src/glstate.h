@@ -0,0 +1,31 @@
+#pragma once
+#include <GL\glew.h>
+
+// Shadow copy of the GL bindings and capability flags the renderer touches, so that asking
+// for what is already current costs no GL call. Everything in render.cpp binds through here;
+// code that changes the same state behind its back must call invalidate() afterwards.
+namespace GLState {
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void bindBuffer(GLenum target, GLuint buffer);
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint texture);
+	void enable(GLenum capability);
+	void disable(GLenum capability);
+
+	// Deleting a bound object unbinds it, and GL hands its name out again
+	void deleteBuffers(GLsizei count, const GLuint * buffers);
+	void deleteVertexArrays(GLsizei count, const GLuint * vaos);
+
+	// Forgets everything, the next call of each kind is always issued. Called once the
+	// context exists, before the first bind.
+	void invalidate();
+
+	struct Counters {
+		int issued;	// calls that reached GL
+		int elided;	// calls skipped because the state was already set
+	};
+	// Starts a new frame, returns the counters of the one that just ended
+	Counters beginFrame();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+
+// 64-bit content hash: FNV-1a over 8-byte words, finished with the murmur3 mixer.
+// Used as the cache key for derived files (mesh caches, shader programs).
+inline unsigned long long hashBytes(const void * data, size_t size, unsigned long long seed = 0)
+{
+	const unsigned long long prime = 0x100000001B3ull;
+	unsigned long long h = 0xCBF29CE484222325ull ^ seed ^ (size * prime);
+	const unsigned char * p = (const unsigned char *)data;
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; i++) {
+		unsigned long long w;
+		memcpy(&w, p + i * 8, 8);
+		h = (h ^ w) * prime;
+		h ^= h >> 29;
+	}
+	for (size_t i = words * 8; i < size; i++) {
+		h = (h ^ p[i]) * prime;
+	}
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
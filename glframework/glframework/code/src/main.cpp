@@ -4,8 +4,10 @@
 #include <imgui\imgui.h>
 #include <imgui\imgui_impl_sdl_gl3.h>
 #include <cstdio>
+#include <cstring>
 
 #include "GL_framework.h"
+#include "bench.h"
 
 
 extern void GUI();
@@ -14,6 +16,12 @@ extern void GLResize(int width, int height);
 extern void GLinit(int width, int height);
 extern void GLcleanup();
 extern void GLrender(float dt);
+extern void GLrequestExercise(int exercise);
+extern int GLmeshesLoading();
+extern int GLprogramsPending();
+extern void GLsetGondolas(int count, int path);
+extern bool GLmultiDrawSupported();
+extern double GLgondolaSubmitSeconds();
 
 //////
 namespace {
@@ -37,6 +45,15 @@ namespace {
 }
 
 int main(int argc, char** argv) {
+	// Offline benchmarks
+	if (argc > 2 && strcmp(argv[1], "--bench-obj") == 0) {
+		return benchOBJ(argv[2]);
+	}
+	// Exercise switch benchmark, runs the normal loop unthrottled
+	bool benchSwitch = argc > 1 && strcmp(argv[1], "--bench-switch") == 0;
+	// Gondola submit benchmark, likewise
+	bool benchGondolas = argc > 1 && strcmp(argv[1], "--bench-gondolas") == 0;
+
 	//Init GLFW
 	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
 		SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
@@ -48,7 +65,8 @@ int main(int argc, char** argv) {
 	SDL_GLContext maincontext;
 
 	SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	// 4.3 for multi-draw indirect, the scene falls back to per-draw submission on 3.3
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
@@ -64,6 +82,11 @@ int main(int argc, char** argv) {
 
 	/* Create our opengl context and attach it to our window */
 	maincontext = SDL_GL_CreateContext(mainwindow);
+	if (!maincontext) {
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+		maincontext = SDL_GL_CreateContext(mainwindow);
+	}
 
 	// Init GLEW
 	GLenum err = glewInit();
@@ -85,6 +108,7 @@ int main(int argc, char** argv) {
 
 	bool quit_app = false;
 	while (!quit_app) {
+		Uint64 frameStart = SDL_GetPerformanceCounter();
 		SDL_Event eve;
 		while (SDL_PollEvent(&eve)) {
 			ImGui_ImplSdlGL3_ProcessEvent(&eve);
@@ -114,7 +138,20 @@ int main(int argc, char** argv) {
 		GLrender((float)expected_frametime);
 
 		SDL_GL_SwapWindow(mainwindow);
-		waitforFrameEnd();
+		if (benchSwitch) {
+			glFinish();
+			double frame = (double)(SDL_GetPerformanceCounter() - frameStart) / SDL_GetPerformanceFrequency();
+			int exercise = benchSwitchFrame(frame, GLmeshesLoading() == 0);
+			if (exercise < 0) quit_app = true;
+			else if (exercise > 0) GLrequestExercise(exercise);
+		}
+		else if (benchGondolas) {
+			int count, path;
+			bool ready = GLmeshesLoading() == 0 && GLprogramsPending() == 0;
+			if (benchGondolasFrame(GLgondolaSubmitSeconds(), ready, GLmultiDrawSupported(), count, path)) GLsetGondolas(count, path);
+			else quit_app = true;
+		}
+		else waitforFrameEnd();
 	}
 
 	ImGui_ImplSdlGL3_Shutdown();
@@ -0,0 +1,283 @@
+#include "meshcache.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <glm\gtc\type_ptr.hpp>
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\packing.hpp>
+
+#include "hash.h"
+#include "meshopt.h"
+#include "pack.h"
+
+namespace {
+	const char meshBinMagic[4] = { 'M', 'B', 'I', 'N' };
+	const unsigned int meshBinVersion = 6;
+	// One interleaved PackedVertex stream, the triangle lists of every LOD back to back,
+	// then the meshlets of the first LOD
+	const unsigned int meshBinLayout = 4;
+
+	const size_t meshletMaxVertices = 64;
+	const size_t meshletMaxTriangles = 124;
+
+	// LOD targets, as a fraction of the triangles of the previous level
+	const float lodReduction = 0.5f;
+	const float lodMaxError = 0.05f;
+
+	struct MeshBinHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int layout;
+		unsigned int vertexCount;
+		unsigned int indexCount;
+		unsigned int indexSize;
+		unsigned int lodCount;
+		MeshLod lods[maxMeshLods];
+		float boundsMin[3];
+		float boundsMax[3];
+		float boundsCenter[3];
+		float boundsRadius;
+		unsigned long long sourceHash;
+		unsigned long long sourceSize;
+		// Byte offsets from the start of the file, 16 byte aligned
+		unsigned int vertexOffset;
+		unsigned int indexOffset;
+		unsigned int meshletOffset;
+		unsigned int meshletCount;
+	};
+
+	size_t align16(size_t n) {
+		return (n + 15) & ~(size_t)15;
+	}
+
+	bool inRange(size_t size, unsigned long long offset, unsigned long long count, unsigned long long stride) {
+		return (offset & 15) == 0 && offset + count * stride <= size;
+	}
+
+	const MeshBinHeader * readMeshBin(const char * data, size_t size, Mesh & out) {
+		if (data == NULL || size < sizeof(MeshBinHeader)) return NULL;
+		const MeshBinHeader * header = (const MeshBinHeader *)data;
+		if (memcmp(header->magic, meshBinMagic, 4) != 0 || header->version != meshBinVersion || header->layout != meshBinLayout) return NULL;
+		if (header->indexSize != 2 && header->indexSize != 4) return NULL;
+		if (!inRange(size, header->vertexOffset, header->vertexCount, sizeof(PackedVertex)) ||
+			!inRange(size, header->indexOffset, header->indexCount, header->indexSize) ||
+			!inRange(size, header->meshletOffset, header->meshletCount, sizeof(Meshlet))) return NULL;
+		if (header->lodCount == 0 || header->lodCount > maxMeshLods) return NULL;
+		for (unsigned int i = 0; i < header->lodCount; i++) {
+			if ((unsigned long long)header->lods[i].firstIndex + header->lods[i].indexCount > header->indexCount) return NULL;
+		}
+
+		out.vertices = (const PackedVertex *)(data + header->vertexOffset);
+		out.indices = data + header->indexOffset;
+		out.vertexCount = header->vertexCount;
+		out.indexCount = header->indexCount;
+		out.indexSize = header->indexSize;
+		out.lodCount = header->lodCount;
+		memcpy(out.lods, header->lods, sizeof(out.lods));
+		out.meshlets = (const Meshlet *)(data + header->meshletOffset);
+		out.meshletCount = header->meshletCount;
+		out.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+		out.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+		out.boundsCenter = glm::vec3(header->boundsCenter[0], header->boundsCenter[1], header->boundsCenter[2]);
+		out.boundsRadius = header->boundsRadius;
+		return header;
+	}
+}
+
+
+void buildMeshBin(const char * name, const ObjData & obj, unsigned long long sourceHash, unsigned long long sourceSize, std::vector< unsigned char > & out)
+{
+	std::vector< glm::vec3 > vertices, normals;
+	std::vector< glm::vec2 > uvs;
+	std::vector< unsigned int > indices;
+	indexOBJ(obj, vertices, uvs, normals, indices);
+
+	// LOD chain: every level simplifies the previous one until it stops shrinking or the
+	// error grows past lodMaxError
+	std::vector< std::vector< unsigned int > > lods(1, indices);
+	std::vector< float > lodErrors(1, 0.f);
+	while (lods.size() < maxMeshLods) {
+		const std::vector< unsigned int > & source = lods.back();
+		size_t target = (size_t)(source.size() / 3 * lodReduction) * 3;
+		std::vector< unsigned int > lod(source.size());
+		float error = 0.f;
+		lod.resize(simplifyMesh(lod.data(), source.data(), source.size(), vertices.data(), vertices.size(), target, lodMaxError, &error));
+		if (lod.empty() || lod.size() > source.size() * 0.9f) break;
+		lodErrors.push_back(glm::max(error, lodErrors.back()));
+		lods.push_back(lod);
+	}
+
+	// Triangle order for the post-transform cache, then vertex order for fetch locality
+	// following the full mesh, whose vertices the other levels only use a subset of
+	VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	MeshLod lodRanges[maxMeshLods];
+	indices.clear();
+	for (size_t i = 0; i < lods.size(); i++) {
+		optimizeVertexCache(lods[i].data(), lods[i].size(), vertices.size());
+		lodRanges[i].firstIndex = (unsigned int)indices.size();
+		lodRanges[i].indexCount = (unsigned int)lods[i].size();
+		lodRanges[i].error = lodErrors[i];
+		indices.insert(indices.end(), lods[i].begin(), lods[i].end());
+	}
+
+	// The full mesh is then regrouped into meshlets for cluster culling
+	std::vector< Meshlet > meshlets;
+	buildMeshlets(indices.data(), lodRanges[0].indexCount, vertices.data(), vertices.size(), meshletMaxVertices, meshletMaxTriangles, meshlets);
+
+	VertexCacheStats after = analyzeVertexCache(indices.data(), lodRanges[0].indexCount, vertices.size());
+	std::vector< unsigned int > remap;
+	size_t used = optimizeVertexFetch(indices.data(), indices.size(), vertices.size(), remap);
+	remapVertices(vertices, remap, used);
+	remapVertices(normals, remap, used);
+	remapVertices(uvs, remap, used);
+	printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, before.acmr, after.acmr, before.atvr, after.atvr);
+	for (size_t i = 1; i < lods.size(); i++) {
+		printf("%s: LOD%d %u triangles, error %.4f\n", name, (int)i, lodRanges[i].indexCount / 3, lodRanges[i].error);
+	}
+	printf("%s: %d meshlets\n", name, (int)meshlets.size());
+
+	MeshBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, meshBinMagic, 4);
+	header.version = meshBinVersion;
+	header.layout = meshBinLayout;
+	header.vertexCount = (unsigned int)vertices.size();
+	header.indexCount = (unsigned int)indices.size();
+	header.indexSize = vertices.size() <= 0x10000 ? 2 : 4;
+	header.lodCount = (unsigned int)lods.size();
+	memcpy(header.lods, lodRanges, lods.size() * sizeof(MeshLod));
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+
+	glm::vec3 boundsMin(0.f), boundsMax(0.f);
+	if (!vertices.empty()) {
+		boundsMin = boundsMax = vertices[0];
+		for (size_t i = 1; i < vertices.size(); i++) {
+			boundsMin = glm::min(boundsMin, vertices[i]);
+			boundsMax = glm::max(boundsMax, vertices[i]);
+		}
+	}
+	memcpy(header.boundsMin, &boundsMin.x, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &boundsMax.x, sizeof(header.boundsMax));
+	// Sphere around the centre of the box, only as large as the furthest vertex needs
+	glm::vec3 boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	float boundsRadius = 0.f;
+	for (size_t i = 0; i < vertices.size(); i++) boundsRadius = glm::max(boundsRadius, glm::length(vertices[i] - boundsCenter));
+	memcpy(header.boundsCenter, &boundsCenter.x, sizeof(header.boundsCenter));
+	header.boundsRadius = boundsRadius;
+
+	size_t offset = align16(sizeof(MeshBinHeader));
+	header.vertexOffset = (unsigned int)offset;
+	offset = align16(offset + vertices.size() * sizeof(PackedVertex));
+	header.indexOffset = (unsigned int)offset;
+	offset = align16(offset + indices.size() * header.indexSize);
+	header.meshletOffset = (unsigned int)offset;
+	header.meshletCount = (unsigned int)meshlets.size();
+	offset = align16(offset + meshlets.size() * sizeof(Meshlet));
+
+	out.assign(offset, 0);
+	memcpy(&out[0], &header, sizeof(header));
+
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec3 invExtent(extent.x > 0.f ? 1.f / extent.x : 0.f, extent.y > 0.f ? 1.f / extent.y : 0.f, extent.z > 0.f ? 1.f / extent.z : 0.f);
+	PackedVertex * packed = (PackedVertex *)&out[header.vertexOffset];
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 unit = glm::clamp((vertices[i] - boundsMin) * invExtent, 0.f, 1.f);
+		packed[i].position[0] = (unsigned short)(unit.x * 65535.f + 0.5f);
+		packed[i].position[1] = (unsigned short)(unit.y * 65535.f + 0.5f);
+		packed[i].position[2] = (unsigned short)(unit.z * 65535.f + 0.5f);
+		packed[i].position[3] = 0;
+		glm::vec3 normal = glm::dot(normals[i], normals[i]) > 0.f ? glm::normalize(normals[i]) : normals[i];
+		packed[i].normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.f));
+		packed[i].uv[0] = glm::packHalf1x16(uvs[i].x);
+		packed[i].uv[1] = glm::packHalf1x16(uvs[i].y);
+	}
+
+	if (header.indexSize == 2) {
+		unsigned short * dst = (unsigned short *)&out[header.indexOffset];
+		for (size_t i = 0; i < indices.size(); i++) dst[i] = (unsigned short)indices[i];
+	}
+	else if (!indices.empty()) {
+		memcpy(&out[header.indexOffset], indices.data(), indices.size() * sizeof(unsigned int));
+	}
+
+	if (!meshlets.empty()) {
+		memcpy(&out[header.meshletOffset], meshlets.data(), meshlets.size() * sizeof(Meshlet));
+	}
+
+	// Against the previous layout: two float3 streams (position, normal), no uv
+	size_t floatBytes = vertices.size() * 2 * sizeof(glm::vec3);
+	size_t packedBytes = vertices.size() * sizeof(PackedVertex);
+	float fetches = after.acmr * (lodRanges[0].indexCount / 3);
+	printf("%s: %u vertices, %.1f KB -> %.1f KB (%d -> %d bytes/vertex), ~%.1f KB -> %.1f KB vertex fetch per draw\n",
+		name, header.vertexCount, floatBytes / 1024.f, packedBytes / 1024.f, (int)(2 * sizeof(glm::vec3)), (int)sizeof(PackedVertex),
+		fetches * 2 * sizeof(glm::vec3) / 1024.f, fetches * sizeof(PackedVertex) / 1024.f);
+}
+
+bool loadMesh(const char * objPath, Mesh & out)
+{
+	out.file.data = NULL;
+	out.file.size = 0;
+	out.file.handle = NULL;
+	out.blob.clear();
+
+	// A packed mesh is used in place. An entry of another .meshbin version or layout is
+	// skipped like a stale one, until the packer runs again.
+	const char * packed;
+	size_t packedSize;
+	if (Pack::find(objPath, packed, packedSize)) {
+		if (readMeshBin(packed, packedSize, out) != NULL) {
+			return true;
+		}
+		printf("Asset pack entry %s is an outdated .meshbin, loading it from the file\n", objPath);
+	}
+
+	MappedFile source;
+	bool hasSource = mapFile(objPath, source);
+	unsigned long long hash = hasSource ? hashBytes(source.data, source.size) : 0;
+
+	// Warm start: the cache is mapped and used in place
+	std::string cachePath = std::string(objPath) + ".meshbin";
+	MappedFile cache;
+	if (mapFile(cachePath.c_str(), cache)) {
+		const MeshBinHeader * header = readMeshBin(cache.data, cache.size, out);
+		if (header != NULL && (!hasSource || (header->sourceHash == hash && header->sourceSize == source.size))) {
+			unmapFile(source);
+			out.file = cache;
+			return true;
+		}
+		unmapFile(cache);
+	}
+
+	if (!hasSource) {
+		printf("Impossible to open the file !\n");
+		return false;
+	}
+	ObjData obj;
+	bool res = parseOBJ(source.data, source.size, obj, 0);
+	unsigned long long sourceSize = source.size;
+	unmapFile(source);
+	if (!res) {
+		return false;
+	}
+
+	buildMeshBin(objPath, obj, hash, sourceSize, out.blob);
+	if (!writeFileAtomic(cachePath.c_str(), out.blob.data(), out.blob.size())) {
+		printf("Could not write the mesh cache %s\n", cachePath.c_str());
+	}
+	return readMeshBin((const char *)out.blob.data(), out.blob.size(), out) != NULL;
+}
+
+void releaseMesh(Mesh & mesh)
+{
+	unmapFile(mesh.file);
+	std::vector< unsigned char >().swap(mesh.blob);
+	mesh.vertices = NULL;
+	mesh.indices = NULL;
+	mesh.vertexCount = 0;
+	mesh.indexCount = 0;
+	mesh.lodCount = 0;
+	mesh.meshlets = NULL;
+	mesh.meshletCount = 0;
+}
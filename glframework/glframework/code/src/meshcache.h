@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <glm\gtc\type_ptr.hpp>
+#include <glm\gtc\matrix_transform.hpp>
+
+#include "filemap.h"
+#include "objloader.h"
+#include "meshopt.h"
+
+// Interleaved 16 byte vertex. The position is unorm16 relative to the mesh bounds
+// (boundsMin + position / 65535 * (boundsMax - boundsMin)), the normal is snorm
+// 10_10_10_2 (GL_INT_2_10_10_10_REV) and the uv is two half floats.
+struct PackedVertex {
+	unsigned short position[4];
+	unsigned int normal;
+	unsigned short uv[2];
+};
+
+const unsigned int maxMeshLods = 4;
+
+// A level of detail is a range of the shared index buffer. error is the largest surface
+// deviation of the simplification, relative to the largest extent of the mesh bounds.
+struct MeshLod {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+};
+
+// GPU-ready indexed mesh. All LODs index the same vertices, lods[0] being the full mesh.
+// The arrays point either into a mapped .meshbin cache file or into blob, which holds the
+// same layout built in memory from the OBJ source.
+struct Mesh {
+	const PackedVertex * vertices;
+	const void * indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;
+	MeshLod lods[maxMeshLods];
+	unsigned int lodCount;
+	// Clusters of lods[0] for culling, firstIndex is into the whole index buffer
+	const Meshlet * meshlets;
+	unsigned int meshletCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	// Bounding sphere, tighter than the one around the box
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	// GeometryArena handle once uploaded, 0 before
+	unsigned int geometry;
+
+	MappedFile file;
+	std::vector< unsigned char > blob;
+};
+
+// Loads objPath from the asset pack when it has an up to date entry of that name,
+// otherwise through its "<objPath>.meshbin" cache. The cache is used as is while the hash
+// of the OBJ contents matches the one it was built from, otherwise the OBJ is parsed and
+// the cache rewritten.
+bool loadMesh(const char * objPath, Mesh & out);
+void releaseMesh(Mesh & mesh);
+
+// Serialises a parsed OBJ into the .meshbin layout, running the import time optimisations
+void buildMeshBin(const char * name, const ObjData & obj, unsigned long long sourceHash, unsigned long long sourceSize, std::vector< unsigned char > & out);
@@ -0,0 +1,480 @@
+#include "meshopt.h"
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <glm\glm.hpp>
+
+
+VertexCacheStats analyzeVertexCache(const unsigned int * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats = { 0.f, 0.f };
+	if (indexCount == 0 || vertexCount == 0) {
+		return stats;
+	}
+
+	// A vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+	std::vector< unsigned int > loadedAt(vertexCount, 0);
+	std::vector< bool > used(vertexCount, false);
+	unsigned int misses = 0;
+	size_t unique = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		unsigned int v = indices[i];
+		if (!used[v] || misses - loadedAt[v] >= cacheSize) {
+			if (!used[v]) unique++;
+			used[v] = true;
+			misses++;
+			loadedAt[v] = misses;
+		}
+	}
+	stats.acmr = (float)misses / (indexCount / 3);
+	stats.atvr = (float)misses / unique;
+	return stats;
+}
+
+void optimizeVertexCache(unsigned int * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Vertex -> triangle adjacency
+	std::vector< unsigned int > live(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++) live[indices[i]]++;
+	std::vector< unsigned int > offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + live[v];
+	std::vector< unsigned int > adjacency(indexCount);
+	std::vector< unsigned int > fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector< unsigned int > cacheTime(vertexCount, 0);
+	std::vector< bool > emitted(triangleCount, false);
+	std::vector< unsigned int > deadEnd;
+	std::vector< unsigned int > candidates;
+	std::vector< unsigned int > result;
+	result.reserve(indexCount);
+
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0;
+	int fanning = 0;
+	while (fanning >= 0) {
+		candidates.clear();
+		for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+			unsigned int t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time;
+					time++;
+				}
+			}
+		}
+
+		// Next fanning vertex: the candidate that stays in cache the longest while its
+		// remaining triangles are emitted, otherwise fall back on the dead-end stack
+		int best = -1;
+		int bestPriority = -1;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			unsigned int v = candidates[c];
+			if (live[v] == 0) continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize) priority = time - cacheTime[v];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		while (best < 0 && !deadEnd.empty()) {
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) best = v;
+		}
+		while (best < 0 && cursor < vertexCount) {
+			if (live[cursor] > 0) best = (int)cursor;
+			cursor++;
+		}
+		fanning = best;
+	}
+
+	for (size_t i = 0; i < result.size(); i++) indices[i] = result[i];
+}
+
+size_t optimizeVertexFetch(unsigned int * indices, size_t indexCount, size_t vertexCount, std::vector< unsigned int > & remap)
+{
+	remap.assign(vertexCount, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		unsigned int & v = indices[i];
+		if (remap[v] == ~0u) remap[v] = next++;
+		v = remap[v];
+	}
+	return next;
+}
+
+namespace {
+	// Symmetric 4x4 plane quadric. Divided by weight it gives the mean squared distance
+	// to the accumulated planes.
+	struct Quadric {
+		float a00, a01, a02, a03;
+		float a11, a12, a13;
+		float a22, a23;
+		float a33;
+		float weight;
+	};
+
+	void addPlane(Quadric & q, const glm::vec3 & n, float d, float weight) {
+		q.a00 += weight * n.x * n.x; q.a01 += weight * n.x * n.y; q.a02 += weight * n.x * n.z; q.a03 += weight * n.x * d;
+		q.a11 += weight * n.y * n.y; q.a12 += weight * n.y * n.z; q.a13 += weight * n.y * d;
+		q.a22 += weight * n.z * n.z; q.a23 += weight * n.z * d;
+		q.a33 += weight * d * d;
+		q.weight += weight;
+	}
+
+	void addQuadric(Quadric & q, const Quadric & r) {
+		q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+		q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+		q.a22 += r.a22; q.a23 += r.a23;
+		q.a33 += r.a33;
+		q.weight += r.weight;
+	}
+
+	float quadricError(const Quadric & q, const glm::vec3 & p) {
+		float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z + q.a03;
+		float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z + q.a13;
+		float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z + q.a23;
+		float rw = q.a03 * p.x + q.a13 * p.y + q.a23 * p.z + q.a33;
+		float e = rx * p.x + ry * p.y + rz * p.z + rw;
+		return e > 0.f && q.weight > 0.f ? e / q.weight : 0.f;
+	}
+
+	struct Collapse {
+		unsigned int from, to;
+		float error;
+		bool operator<(const Collapse & other) const { return error < other.error; }
+	};
+
+	bool samePosition(const glm::vec3 & a, const glm::vec3 & b) {
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	bool lessPosition(const glm::vec3 & a, const glm::vec3 & b) {
+		if (a.x != b.x) return a.x < b.x;
+		if (a.y != b.y) return a.y < b.y;
+		return a.z < b.z;
+	}
+}
+
+size_t simplifyMesh(unsigned int * destination, const unsigned int * indices, size_t indexCount, const glm::vec3 * positions, size_t vertexCount,
+	size_t targetIndexCount, float targetError, float * resultError)
+{
+	if (resultError) *resultError = 0.f;
+	for (size_t i = 0; i < indexCount; i++) destination[i] = indices[i];
+	if (indexCount <= targetIndexCount || vertexCount == 0) {
+		return indexCount;
+	}
+
+	// Work in a unit box so errors are relative to the mesh size
+	glm::vec3 boundsMin = positions[0], boundsMax = positions[0];
+	for (size_t v = 1; v < vertexCount; v++) {
+		boundsMin = glm::min(boundsMin, positions[v]);
+		boundsMax = glm::max(boundsMax, positions[v]);
+	}
+	glm::vec3 extent = boundsMax - boundsMin;
+	float scale = glm::max(extent.x, glm::max(extent.y, extent.z));
+	scale = scale > 0.f ? 1.f / scale : 0.f;
+	std::vector< glm::vec3 > points(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) points[v] = (positions[v] - boundsMin) * scale;
+
+	// Vertices sharing a position with another vertex sit on a uv or normal seam
+	std::vector< bool > locked(vertexCount, false);
+	std::vector< unsigned int > order(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) order[v] = (unsigned int)v;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return lessPosition(points[a], points[b]); });
+	std::vector< unsigned int > canonical(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		bool shared = i > 0 && samePosition(points[order[i]], points[order[i - 1]]);
+		canonical[order[i]] = shared ? canonical[order[i - 1]] : order[i];
+		if (shared) {
+			locked[order[i]] = true;
+			locked[order[i - 1]] = true;
+		}
+	}
+
+	// Edges without a twin in the opposite direction lie on an open border
+	std::vector< unsigned long long > edges;
+	edges.reserve(indexCount);
+	for (size_t i = 0; i < indexCount; i += 3) {
+		for (int k = 0; k < 3; k++) {
+			unsigned long long a = canonical[indices[i + k]], b = canonical[indices[i + (k + 1) % 3]];
+			edges.push_back((a << 32) | b);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t e = 0; e < edges.size(); e++) {
+		unsigned long long a = edges[e] >> 32, b = edges[e] & 0xffffffffull;
+		if (!std::binary_search(edges.begin(), edges.end(), (b << 32) | a)) {
+			locked[a] = true;
+			locked[b] = true;
+		}
+	}
+	for (size_t v = 0; v < vertexCount; v++) {
+		if (locked[canonical[v]]) locked[v] = true;
+	}
+
+	// Area weighted plane quadrics of the incident triangles
+	Quadric zero = {};
+	std::vector< Quadric > quadrics(vertexCount, zero);
+	for (size_t i = 0; i < indexCount; i += 3) {
+		const glm::vec3 & p0 = points[indices[i]];
+		glm::vec3 normal = glm::cross(points[indices[i + 1]] - p0, points[indices[i + 2]] - p0);
+		float area = glm::length(normal);
+		if (area == 0.f) continue;
+		normal /= area;
+		for (int k = 0; k < 3; k++) addPlane(quadrics[indices[i + k]], normal, -glm::dot(normal, p0), area);
+	}
+
+	std::vector< unsigned int > offsets(vertexCount + 1);
+	std::vector< unsigned int > adjacency;
+	std::vector< Collapse > collapses;
+	std::vector< bool > touched(vertexCount);
+	std::vector< unsigned int > remap(vertexCount);
+	float maxError = 0.f;
+	float errorLimit = targetError * targetError;
+
+	while (indexCount > targetIndexCount) {
+		// Vertex -> triangle adjacency of the current triangle list
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (size_t i = 0; i < indexCount; i++) offsets[destination[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+		adjacency.resize(indexCount);
+		std::vector< unsigned int > fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; i++) adjacency[fill[destination[i]]++] = (unsigned int)(i / 3);
+
+		collapses.clear();
+		for (size_t i = 0; i < indexCount; i += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = destination[i + k], b = destination[i + (k + 1) % 3];
+				Quadric q = quadrics[a];
+				addQuadric(q, quadrics[b]);
+				if (!locked[a]) {
+					Collapse c = { a, b, quadricError(q, points[b]) };
+					collapses.push_back(c);
+				}
+				if (!locked[b]) {
+					Collapse c = { b, a, quadricError(q, points[a]) };
+					collapses.push_back(c);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		std::fill(touched.begin(), touched.end(), false);
+		for (size_t v = 0; v < vertexCount; v++) remap[v] = (unsigned int)v;
+		size_t removable = (indexCount - targetIndexCount) / 3;
+		size_t removed = 0;
+		for (size_t c = 0; c < collapses.size() && removed < removable; c++) {
+			const Collapse & collapse = collapses[c];
+			if (collapse.error > errorLimit) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// Reject collapses that flip a surviving triangle around the removed vertex
+			bool flips = false;
+			size_t lost = 0;
+			for (unsigned int a = offsets[collapse.from]; a < offsets[collapse.from + 1] && !flips; a++) {
+				const unsigned int * tri = &destination[adjacency[a] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+					lost++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = points[tri[k]];
+					q[k] = tri[k] == collapse.from ? points[collapse.to] : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.f;
+			}
+			if (flips) continue;
+
+			// Neighbouring triangles change too, keep their vertices out of this pass
+			for (unsigned int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++) {
+				const unsigned int * tri = &destination[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+			remap[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = glm::max(maxError, collapse.error);
+			removed += lost;
+		}
+		if (removed == 0) break;
+
+		size_t written = 0;
+		for (size_t i = 0; i < indexCount; i += 3) {
+			unsigned int a = remap[destination[i]], b = remap[destination[i + 1]], c = remap[destination[i + 2]];
+			if (a == b || b == c || c == a) continue;
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+		indexCount = written;
+	}
+
+	if (resultError) *resultError = sqrtf(maxError);
+	return indexCount;
+}
+
+namespace {
+	void computeMeshletBounds(Meshlet & meshlet, const unsigned int * indices, const glm::vec3 * positions) {
+		// Bounding sphere: centre of the AABB, radius to the furthest corner vertex
+		glm::vec3 boundsMin = positions[indices[0]], boundsMax = boundsMin;
+		for (unsigned int i = 1; i < meshlet.indexCount; i++) {
+			boundsMin = glm::min(boundsMin, positions[indices[i]]);
+			boundsMax = glm::max(boundsMax, positions[indices[i]]);
+		}
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float radius = 0.f;
+		for (unsigned int i = 0; i < meshlet.indexCount; i++) radius = glm::max(radius, glm::length(positions[indices[i]] - center));
+
+		// Cone around the mean triangle normal. Wider than 90 degrees (or degenerate) means
+		// the cluster can always be seen from somewhere, so the cutoff is set to never cull.
+		std::vector< glm::vec3 > normals;
+		glm::vec3 axis(0.f);
+		for (unsigned int i = 0; i < meshlet.indexCount; i += 3) {
+			const glm::vec3 & p0 = positions[indices[i]];
+			glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+			float area = glm::length(normal);
+			if (area == 0.f) continue;
+			normals.push_back(normal / area);
+			axis += normal / area;
+		}
+		float cutoff = 1.f;
+		float axisLength = glm::length(axis);
+		if (axisLength > 0.f) {
+			axis /= axisLength;
+			float minDot = 1.f;
+			for (size_t t = 0; t < normals.size(); t++) minDot = glm::min(minDot, glm::dot(normals[t], axis));
+			if (minDot > 0.1f) cutoff = sqrtf(1.f - minDot * minDot);
+		}
+
+		for (int k = 0; k < 3; k++) {
+			meshlet.center[k] = center[k];
+			meshlet.coneAxis[k] = axis[k];
+		}
+		meshlet.radius = radius;
+		meshlet.coneCutoff = cutoff;
+	}
+}
+
+void buildMeshlets(unsigned int * indices, size_t indexCount, const glm::vec3 * positions, size_t vertexCount,
+	size_t maxVertices, size_t maxTriangles, std::vector< Meshlet > & meshlets)
+{
+	meshlets.clear();
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Vertex -> triangle adjacency and unit triangle normals
+	std::vector< unsigned int > offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) offsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+	std::vector< unsigned int > adjacency(triangleCount * 3);
+	std::vector< unsigned int > fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	std::vector< glm::vec3 > normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		const glm::vec3 & p0 = positions[indices[t * 3]];
+		glm::vec3 normal = glm::cross(positions[indices[t * 3 + 1]] - p0, positions[indices[t * 3 + 2]] - p0);
+		float area = glm::length(normal);
+		normals[t] = area > 0.f ? normal / area : normal;
+	}
+
+	std::vector< unsigned int > result;
+	result.reserve(triangleCount * 3);
+	std::vector< bool > emitted(triangleCount, false);
+	// Meshlet the vertex was last added to, so membership checks are O(1)
+	std::vector< unsigned int > owner(vertexCount, ~0u);
+	std::vector< unsigned int > candidates;
+	std::vector< unsigned int > local;
+	size_t seed = 0;
+
+	while (result.size() < triangleCount * 3) {
+		// Seeds follow the incoming (cache-optimised) order
+		while (emitted[seed]) seed++;
+		unsigned int id = (unsigned int)meshlets.size();
+		Meshlet meshlet = {};
+		meshlet.firstIndex = (unsigned int)result.size();
+		size_t vertices = 0;
+		glm::vec3 axis(0.f);
+		candidates.clear();
+		candidates.push_back((unsigned int)seed);
+
+		// Grow through shared vertices, preferring triangles that add the fewest new
+		// vertices and then those closest to the meshlet's mean normal (tighter cones)
+		while (meshlet.indexCount / 3 < maxTriangles) {
+			int best = -1;
+			unsigned int bestNew = 4;
+			float bestDot = -2.f;
+			size_t live = 0;
+			for (size_t c = 0; c < candidates.size(); c++) {
+				unsigned int t = candidates[c];
+				if (emitted[t]) continue;
+				candidates[live++] = t;
+				unsigned int added = 0;
+				for (int k = 0; k < 3; k++) {
+					if (owner[indices[t * 3 + k]] != id) added++;
+				}
+				if (vertices + added > maxVertices) continue;
+				float d = glm::dot(normals[t], axis);
+				if (added < bestNew || (added == bestNew && d > bestDot)) {
+					best = (int)t;
+					bestNew = added;
+					bestDot = d;
+				}
+			}
+			candidates.resize(live);
+			if (best < 0) break;
+
+			emitted[best] = true;
+			axis += normals[best];
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[best * 3 + k];
+				result.push_back(v);
+				if (owner[v] != id) {
+					owner[v] = id;
+					vertices++;
+					for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++) {
+						if (!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+					}
+				}
+			}
+			meshlet.indexCount += 3;
+		}
+
+		// Growth order is not cache friendly, so each meshlet gets its own Tipsify pass on
+		// vertices renumbered locally (at most maxVertices of them)
+		unsigned int * range = &result[meshlet.firstIndex];
+		local.clear();
+		for (unsigned int i = 0; i < meshlet.indexCount; i++) {
+			unsigned int v = range[i];
+			unsigned int slot = 0;
+			while (slot < local.size() && local[slot] != v) slot++;
+			if (slot == local.size()) local.push_back(v);
+			range[i] = slot;
+		}
+		optimizeVertexCache(range, meshlet.indexCount, local.size());
+		for (unsigned int i = 0; i < meshlet.indexCount; i++) range[i] = local[range[i]];
+
+		computeMeshletBounds(meshlet, range, positions);
+		meshlets.push_back(meshlet);
+	}
+
+	for (size_t i = 0; i < result.size(); i++) indices[i] = result[i];
+}
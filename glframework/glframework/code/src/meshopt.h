@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include <glm\vec3.hpp>
+
+// Import time optimisations on indexed triangle lists.
+
+struct VertexCacheStats {
+	float acmr;	// transformed vertices per triangle
+	float atvr;	// transformed vertices per unique vertex
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+VertexCacheStats analyzeVertexCache(const unsigned int * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Tipsify, Sander et al. 2007)
+void optimizeVertexCache(unsigned int * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Renumbers vertices in order of first use so fetches walk the vertex buffer forwards.
+// Rewrites indices and fills remap (old -> new, ~0u for unused vertices); returns the
+// number of vertices still referenced. Apply remap to every stream with remapVertices.
+size_t optimizeVertexFetch(unsigned int * indices, size_t indexCount, size_t vertexCount, std::vector< unsigned int > & remap);
+
+// Quadric error edge collapse (Garland and Heckbert 1997). A vertex only ever collapses onto
+// one of its neighbours, so the result indexes the same vertex buffer as the input. Vertices
+// on open borders or on uv/normal seams are locked. Stops at targetIndexCount or when the
+// next collapse would move the surface further than targetError, both relative to the largest
+// extent of the mesh. Writes up to indexCount indices to destination and returns how many were
+// written; resultError receives the error actually reached.
+size_t simplifyMesh(unsigned int * destination, const unsigned int * indices, size_t indexCount, const glm::vec3 * positions, size_t vertexCount,
+	size_t targetIndexCount, float targetError, float * resultError);
+
+// A cluster of consecutive triangles in an index buffer, with a bounding sphere and a
+// normal cone. The cluster is entirely back-facing from any camera position c for which
+// dot(center - c, coneAxis) >= coneCutoff * length(center - c) + radius.
+struct Meshlet {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+// Groups the triangles of indices[0, indexCount) into clusters of at most maxVertices
+// unique vertices and maxTriangles triangles, grown over shared vertices, and reorders
+// the indices so each cluster is a contiguous range. Meshlet ranges are relative to indices.
+void buildMeshlets(unsigned int * indices, size_t indexCount, const glm::vec3 * positions, size_t vertexCount,
+	size_t maxVertices, size_t maxTriangles, std::vector< Meshlet > & meshlets);
+
+template < typename T >
+void remapVertices(std::vector< T > & stream, const std::vector< unsigned int > & remap, size_t newCount)
+{
+	std::vector< T > result(newCount);
+	for (size_t i = 0; i < stream.size() && i < remap.size(); i++) {
+		if (remap[i] != ~0u) result[remap[i]] = stream[i];
+	}
+	stream.swap(result);
+}
@@ -0,0 +1,246 @@
+#include <vector>
+
+#include "geometryarena.h"
+#include "glstate.h"
+#include "multidraw.h"
+#include "renderqueue.h"
+#include "shader.h"
+
+namespace {
+	// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// std430 DrawData of MultiDrawVert.txt
+	struct DrawData {
+		glm::mat4 objMat;
+		glm::vec3 posOffset;
+		GLuint material;
+		glm::vec3 posScale;
+		float padding;
+	};
+
+	const char * attributes[] = { "in_Position", "in_Normal", "in_UV", "in_DrawID" };
+	const GLuint drawIdLocation = 3;
+	// CullComp.txt: group size and storage buffers besides the draw data
+	const GLuint cullGroupSize = 64;
+	const GLuint candidateBinding = 3;
+	const GLuint sphereBinding = 4;
+	const GLuint culledBinding = 5;
+	const GLuint countBinding = 6;
+
+	ShaderProgram * program;
+	ShaderProgram * culledProgram;	// draws what cullProgram wrote
+	ShaderProgram * cullProgram;
+	GLuint vao;
+	GLuint drawIdBuffer, commandBuffer, drawBuffer, materialBuffer;
+	GLuint sphereBuffer, culledBuffer, countBuffer;
+	size_t drawIdCapacity;
+	bool countDraw;
+
+	// A call per index type, 16 bit first. Draw data is uploaded in the same order.
+	std::vector< DrawCommand > commands[2];
+	std::vector< DrawData > draws[2];
+	std::vector< glm::vec4 > spheres[2];
+	std::vector< glm::vec4 > materials;
+	MultiDraw::Stats stats;
+
+	GLuint material(const glm::vec3 & color) {
+		for (size_t i = 0; i < materials.size(); i++) {
+			if (glm::vec3(materials[i]) == color) return (GLuint)i;
+		}
+		materials.push_back(glm::vec4(color, 1.f));
+		return (GLuint)materials.size() - 1;
+	}
+
+	void upload(GLenum target, GLuint buffer, const void * data, size_t size) {
+		GLState::bindBuffer(target, buffer);
+		glBufferData(target, size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(target, 0, size, data);
+	}
+
+	// Draw IDs 0, 1, 2... read with divisor 1, so baseInstance picks the command's own
+	void growDrawIds(size_t count) {
+		if (count <= drawIdCapacity) return;
+		while (drawIdCapacity < count) drawIdCapacity *= 2;
+		std::vector< GLuint > ids(drawIdCapacity);
+		for (size_t i = 0; i < ids.size(); i++) ids[i] = (GLuint)i;
+		GLState::bindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Fills culledBuffer (and countBuffer) from the uploaded candidates, leaves the draw
+	// program bound again
+	void cull(size_t total, size_t split) {
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, culledBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, total * sizeof(DrawCommand), NULL, GL_STREAM_DRAW);
+		GLuint zero[2] = { 0, 0 };
+		upload(GL_SHADER_STORAGE_BUFFER, countBuffer, zero, sizeof(zero));
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, candidateBinding, commandBuffer);
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, sphereBinding, sphereBuffer);
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, culledBinding, culledBuffer);
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, countBinding, countBuffer);
+
+		GLState::useProgram(cullProgram->id);
+		setUniform(cullProgram, U_draw_Count, (int)total);
+		setUniform(cullProgram, U_draw_Split, (int)split);
+		glDispatchCompute((GLuint)(total + cullGroupSize - 1) / cullGroupSize, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		GLState::useProgram(culledProgram->id);
+	}
+
+	void drawBatch(const RenderQueue::DrawItem & item) {
+		bool gpuCulled = item.program == culledProgram;
+		size_t shortCommands = commands[0].size();
+		size_t total = shortCommands + commands[1].size();
+		// Culled commands keep their global index as baseInstance, the attribute reads it
+		if (gpuCulled) {
+			for (size_t i = 0; i < commands[1].size(); i++) commands[1][i].baseInstance += (GLuint)shortCommands;
+		}
+		commands[0].insert(commands[0].end(), commands[1].begin(), commands[1].end());
+		draws[0].insert(draws[0].end(), draws[1].begin(), draws[1].end());
+
+		growDrawIds(gpuCulled ? total : (shortCommands > commands[1].size() ? shortCommands : commands[1].size()));
+		upload(gpuCulled ? GL_SHADER_STORAGE_BUFFER : GL_DRAW_INDIRECT_BUFFER, commandBuffer, commands[0].data(), total * sizeof(DrawCommand));
+		upload(GL_SHADER_STORAGE_BUFFER, drawBuffer, draws[0].data(), total * sizeof(DrawData));
+		upload(GL_SHADER_STORAGE_BUFFER, materialBuffer, materials.data(), materials.size() * sizeof(glm::vec4));
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, MultiDraw::drawDataBinding, drawBuffer);
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, MultiDraw::materialBinding, materialBuffer);
+		if (gpuCulled) {
+			spheres[0].insert(spheres[0].end(), spheres[1].begin(), spheres[1].end());
+			upload(GL_SHADER_STORAGE_BUFFER, sphereBuffer, spheres[0].data(), total * sizeof(glm::vec4));
+			cull(total, shortCommands);
+			GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, culledBuffer);
+			if (countDraw) GLState::bindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+		}
+
+		stats.commands = (int)total;
+		stats.calls = 0;
+		const GLenum types[] = { GL_UNSIGNED_SHORT, GL_UNSIGNED_INT };
+		size_t first[] = { 0, shortCommands };
+		size_t count[] = { shortCommands, commands[1].size() };
+		for (int type = 0; type < 2; type++) {
+			if (count[type] == 0) continue;
+			const void * indirect = (const void *)(first[type] * sizeof(DrawCommand));
+			if (!gpuCulled) {
+				setUniform(program, U_draw_Offset, (int)first[type]);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, types[type], indirect, (GLsizei)count[type], 0);
+			}
+			else if (countDraw) {
+				setUniform(culledProgram, U_draw_Offset, 0);
+				glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, types[type], indirect, type * sizeof(GLuint), (GLsizei)count[type], 0);
+			}
+			else {
+				setUniform(culledProgram, U_draw_Offset, 0);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, types[type], indirect, (GLsizei)count[type], 0);
+			}
+			stats.calls++;
+		}
+
+		for (int type = 0; type < 2; type++) {
+			commands[type].clear();
+			draws[type].clear();
+			spheres[type].clear();
+		}
+		materials.clear();
+	}
+}
+
+namespace MultiDraw {
+	bool supported() {
+		return GLEW_VERSION_4_3 != 0;
+	}
+
+	void setup() {
+		stats = Stats();
+		if (!supported()) return;
+		stats.drawParameters = GLEW_ARB_shader_draw_parameters != 0;
+		countDraw = GLEW_ARB_indirect_parameters != 0;
+		stats.countDraw = countDraw;
+		program = acquireProgramAsync("MultiDrawVert.txt", "BasicFrag.txt", attributes, 4, "MULTI_DRAW");
+		culledProgram = acquireProgramAsync("MultiDrawVert.txt", "BasicFrag.txt", attributes, 4, "MULTI_DRAW GPU_CULLED");
+		cullProgram = acquireComputeProgramAsync("CullComp.txt", countDraw ? "COMPACT" : "");
+
+		GLuint buffers[7];
+		glGenBuffers(7, buffers);
+		drawIdBuffer = buffers[0];
+		commandBuffer = buffers[1];
+		drawBuffer = buffers[2];
+		materialBuffer = buffers[3];
+		sphereBuffer = buffers[4];
+		culledBuffer = buffers[5];
+		countBuffer = buffers[6];
+		drawIdCapacity = 1;
+		growDrawIds(1024);
+
+		vao = GeometryArena::createVertexArray();
+		GLState::bindVertexArray(vao);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+		glVertexAttribIPointer(drawIdLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+		glEnableVertexAttribArray(drawIdLocation);
+		glVertexAttribDivisor(drawIdLocation, 1);
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void cleanup() {
+		if (program == NULL) return;
+		GeometryArena::deleteVertexArray(vao);
+		GLuint buffers[] = { drawIdBuffer, commandBuffer, drawBuffer, materialBuffer, sphereBuffer, culledBuffer, countBuffer };
+		GLState::deleteBuffers(7, buffers);
+		releaseProgram(program);
+		releaseProgram(culledProgram);
+		releaseProgram(cullProgram);
+		program = culledProgram = cullProgram = NULL;
+	}
+
+	bool ready() {
+		return program != NULL && program->linked;
+	}
+
+	bool cullingReady() {
+		return ready() && culledProgram->linked && cullProgram->linked;
+	}
+
+	void add(const Mesh & mesh, unsigned int firstIndex, unsigned int count, const glm::mat4 & objMat, const glm::vec3 & color, const glm::vec4 & sphere) {
+		int type = mesh.indexSize == 2 ? 0 : 1;
+		DrawCommand command;
+		command.count = count;
+		command.instanceCount = 1;
+		command.firstIndex = (GLuint)(GeometryArena::indexOffset(mesh.geometry) / mesh.indexSize) + firstIndex;
+		command.baseVertex = GeometryArena::baseVertex(mesh.geometry);
+		command.baseInstance = (GLuint)commands[type].size();
+		commands[type].push_back(command);
+
+		DrawData draw;
+		draw.objMat = objMat;
+		draw.posOffset = mesh.boundsMin;
+		draw.material = material(color);
+		draw.posScale = mesh.boundsMax - mesh.boundsMin;
+		draw.padding = 0.f;
+		draws[type].push_back(draw);
+		spheres[type].push_back(sphere);
+	}
+
+	void queue(bool gpuCulled) {
+		stats.commands = stats.calls = 0;
+		stats.gpuCulled = gpuCulled;
+		if (commands[0].empty() && commands[1].empty()) return;
+		RenderQueue::DrawItem item = {};
+		item.program = gpuCulled ? culledProgram : program;
+		item.vao = vao;
+		item.draw = drawBatch;
+		item.key = RenderQueue::makeKey(RenderQueue::PassOpaque, item.program->id, vao, 0, 0.f);
+		RenderQueue::push(item);
+	}
+
+	Stats getStats() {
+		return stats;
+	}
+}
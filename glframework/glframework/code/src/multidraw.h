@@ -0,0 +1,44 @@
+#pragma once
+#include <GL\glew.h>
+#include <glm\gtc\type_ptr.hpp>
+
+#include "meshcache.h"
+
+// Flat shaded arena meshes submitted with glMultiDrawElementsIndirect, one command per mesh
+// range. Transforms, dequantisation ranges and material indices go to a storage buffer the
+// vertex shader (MultiDrawVert.txt) indexes with the draw ID, colours to a second one.
+// Needs GL 4.3; elsewhere the renderer keeps drawing these meshes one by one.
+// With GPU culling the commands are only candidates: a compute pass (CullComp.txt) tests
+// their bounding spheres against the frustum and writes the commands that are drawn, their
+// number going straight to glMultiDrawElementsIndirectCountARB (GL_ARB_indirect_parameters).
+// Without that extension culled commands stay in place with no instances, at a fixed count.
+namespace MultiDraw {
+	// Storage buffer bindings, as declared by MultiDrawVert.txt
+	const GLuint drawDataBinding = 1;
+	const GLuint materialBinding = 2;
+
+	bool supported();
+	void setup();
+	void cleanup();
+	// Supported and the program has compiled and linked, not only finished trying
+	bool ready();
+	// Likewise for the culling pass and the program drawing its output
+	bool cullingReady();
+
+	// Adds a command drawing count indices of mesh, starting at its firstIndex-th. sphere
+	// bounds those indices in object space (xyz centre, w radius), for GPU culling.
+	void add(const Mesh & mesh, unsigned int firstIndex, unsigned int count, const glm::mat4 & objMat, const glm::vec3 & color, const glm::vec4 & sphere);
+	// Pushes everything added since the last call to the render queue as a single item,
+	// culled on the GPU before drawing when gpuCulled (needs cullingReady)
+	void queue(bool gpuCulled);
+
+	struct Stats {
+		int commands;
+		int calls;	// one per index type present
+		bool drawParameters;	// gl_DrawIDARB, otherwise the draw ID comes from baseInstance
+		bool gpuCulled;
+		bool countDraw;	// culled commands are compacted and counted on the GPU
+	};
+	// Counters of the last submitted batch
+	Stats getStats();
+}
@@ -1,11 +1,382 @@
 #include "objloader.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <glm\gtc\type_ptr.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 
+#include "filemap.h"
 
+namespace {
+	const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t';
+	}
+	inline bool isDigit(char c) {
+		return (unsigned char)(c - '0') < 10;
+	}
+	inline const char * skipBlanks(const char * p, const char * end) {
+		while (p < end && isBlank(*p)) p++;
+		return p;
+	}
+	inline const char * skipLine(const char * p, const char * end) {
+		const char * nl = (const char *)memchr(p, '\n', end - p);
+		return nl ? nl + 1 : end;
+	}
+
+	// Slow path for anything the fast parser does not handle exactly (nan, inf, huge exponents)
+	const char * parseFloatSlow(const char * p, const char * end, float & out) {
+		char buff[64];
+		size_t n = 0;
+		while (p + n < end && n < sizeof(buff) - 1 && !isBlank(p[n]) && p[n] != '\r' && p[n] != '\n') {
+			buff[n] = p[n];
+			n++;
+		}
+		buff[n] = '\0';
+		char * stop;
+		out = (float)strtod(buff, &stop);
+		return p + (stop - buff);
+	}
+
+	const char * parseFloat(const char * p, const char * end, float & out) {
+		const char * start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		// Up to 19 significant digits fit in the mantissa, the rest only scale it
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+		while (p < end && isDigit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) digits++;
+			}
+			else {
+				exponent++;
+			}
+			p++;
+			any = true;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && isDigit(*p)) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0) digits++;
+					exponent--;
+				}
+				p++;
+				any = true;
+			}
+		}
+		if (!any) {
+			return parseFloatSlow(start, end, out);
+		}
+		if (p + 1 < end && (*p == 'e' || *p == 'E') && (isDigit(p[1]) || p[1] == '-' || p[1] == '+')) {
+			const char * q = p + 1;
+			bool expNegative = false;
+			if (*q == '-' || *q == '+') {
+				expNegative = *q == '-';
+				q++;
+			}
+			if (q < end && isDigit(*q)) {
+				int e = 0;
+				while (q < end && isDigit(*q)) {
+					if (e < 10000) e = e * 10 + (*q - '0');
+					q++;
+				}
+				exponent += expNegative ? -e : e;
+				p = q;
+			}
+		}
+
+		if (exponent < -22 || exponent > 22) {
+			return parseFloatSlow(start, end, out);
+		}
+		double value = (double)mantissa;
+		if (exponent < 0) value /= pow10[-exponent];
+		else value *= pow10[exponent];
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	// Returns p unchanged when there is no index to read
+	inline const char * parseIndex(const char * p, const char * end, int & out) {
+		const char * start = p;
+		bool negative = false;
+		if (p < end && *p == '-') {
+			negative = true;
+			p++;
+		}
+		if (p >= end || !isDigit(*p)) {
+			out = 0;
+			return start;
+		}
+		long long value = 0;
+		while (p < end && isDigit(*p)) {
+			if (value < 0x7fffffff) value = value * 10 + (*p - '0');
+			p++;
+		}
+		if (value > 0x7fffffff) value = 0x7fffffff;
+		out = (int)(negative ? -value : value);
+		return p;
+	}
+
+	const char * parseVec(const char * p, const char * end, float * out, int count) {
+		for (int i = 0; i < count; i++) {
+			p = skipBlanks(p, end);
+			if (p >= end || *p == '\r' || *p == '\n') {
+				out[i] = 0.f;
+				continue;
+			}
+			p = parseFloat(p, end, out[i]);
+		}
+		return p;
+	}
+
+	inline void emitCorner(ObjData & out, std::vector< size_t > * relative, const unsigned int * corner, int relativeMask) {
+		if (relative != NULL && relativeMask != 0) {
+			for (int k = 0; k < 3; k++) {
+				if (relativeMask & (1 << k)) relative->push_back(out.faces.size() + k);
+			}
+		}
+		out.faces.insert(out.faces.end(), corner, corner + 3);
+	}
+
+	// Parses [begin, end), which must start at the beginning of a line. When relative is
+	// given, negative indices are kept chunk-local and their positions in faces recorded
+	bool parseRange(const char * begin, const char * end, ObjData & out, std::vector< size_t > * relative) {
+		const char * p = begin;
+		while (p < end) {
+			p = skipBlanks(p, end);
+			if (p >= end) break;
+
+			char c0 = *p;
+			char c1 = p + 1 < end ? p[1] : '\n';
+			char c2 = p + 2 < end ? p[2] : '\n';
+
+			if (c0 == 'v' && isBlank(c1)) {
+				glm::vec3 vertex;
+				p = parseVec(p + 1, end, &vertex.x, 3);
+				out.vertices.push_back(vertex);
+			}
+			else if (c0 == 'v' && c1 == 't' && isBlank(c2)) {
+				glm::vec2 uv;
+				p = parseVec(p + 2, end, &uv.x, 2);
+				out.uvs.push_back(uv);
+			}
+			else if (c0 == 'v' && c1 == 'n' && isBlank(c2)) {
+				glm::vec3 normal;
+				p = parseVec(p + 2, end, &normal.x, 3);
+				out.normals.push_back(normal);
+			}
+			else if (c0 == 'f' && isBlank(c1)) {
+				int counts[3] = { (int)out.vertices.size(), (int)out.uvs.size(), (int)out.normals.size() };
+				unsigned int first[3], prev[3];
+				int firstRelative = 0, prevRelative = 0;
+				int corners = 0;
+				p++;
+				while (true) {
+					p = skipBlanks(p, end);
+					if (p >= end || *p == '\r' || *p == '\n' || *p == '#') break;
+
+					int idx[3] = { 0, 0, 0 };
+					const char * q = parseIndex(p, end, idx[0]);
+					if (q == p) {
+						printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+						return false;
+					}
+					p = q;
+					if (p < end && *p == '/') {
+						p = parseIndex(p + 1, end, idx[1]);
+						if (p < end && *p == '/') {
+							p = parseIndex(p + 1, end, idx[2]);
+						}
+					}
+
+					unsigned int corner[3];
+					int cornerRelative = 0;
+					for (int k = 0; k < 3; k++) {
+						// Negative indices are relative to the end of the list read so far. Inside a
+						// chunk that may point before the chunk, so they are fixed up once merged
+						int i = idx[k] < 0 ? counts[k] + idx[k] + 1 : idx[k];
+						if (idx[k] < 0) {
+							if (relative == NULL && i <= 0) {
+								printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+								return false;
+							}
+							cornerRelative |= 1 << k;
+						}
+						corner[k] = (unsigned int)i;
+					}
+
+					if (corners >= 2) {
+						emitCorner(out, relative, first, firstRelative);
+						emitCorner(out, relative, prev, prevRelative);
+						emitCorner(out, relative, corner, cornerRelative);
+					}
+					if (corners == 0) {
+						memcpy(first, corner, sizeof(corner));
+						firstRelative = cornerRelative;
+					}
+					memcpy(prev, corner, sizeof(corner));
+					prevRelative = cornerRelative;
+					corners++;
+				}
+				if (corners < 3) {
+					printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+					return false;
+				}
+			}
+			p = skipLine(p, end);
+		}
+		return true;
+	}
+
+	// Files below autoParallelSize are parsed on the calling thread only
+	const size_t minChunkSize = 1 << 20;
+	const size_t autoParallelSize = 4 << 20;
+
+	struct ObjChunk {
+		const char * begin;
+		const char * end;
+		ObjData data;
+		std::vector< size_t > relative;
+		bool ok;
+	};
+
+	// Runs job(i) for every i in [0, count) on up to `threads` threads, the caller included
+	template < typename Job >
+	void runParallel(size_t count, unsigned int threads, const Job & job) {
+		std::atomic< size_t > next(0);
+		auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++) job(i);
+		};
+		std::vector< std::thread > pool;
+		for (unsigned int t = 1; t < threads && t < count; t++) {
+			pool.push_back(std::thread(worker));
+		}
+		worker();
+		for (size_t t = 0; t < pool.size(); t++) {
+			pool[t].join();
+		}
+	}
+
+	inline unsigned int hashCorner(const unsigned int * c) {
+		unsigned int h = c[0] * 0x9E3779B1u;
+		h ^= c[1] * 0x85EBCA77u + (h << 6) + (h >> 2);
+		h ^= c[2] * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+		return h ^ (h >> 15);
+	}
+
+	bool validateFaces(const ObjData & obj) {
+		size_t counts[3] = { obj.vertices.size(), obj.uvs.size(), obj.normals.size() };
+		for (size_t i = 0; i < obj.faces.size(); i++) {
+			unsigned int idx = obj.faces[i];
+			if (idx > counts[i % 3] || (idx == 0 && i % 3 == 0)) {
+				printf("OBJ face references a missing element (%u)\n", idx);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+bool parseOBJ(const char * data, size_t size, ObjData & out, unsigned int threads)
+{
+	out.vertices.clear();
+	out.uvs.clear();
+	out.normals.clear();
+	out.faces.clear();
+
+	if (threads == 0) {
+		threads = size < autoParallelSize ? 1 : std::thread::hardware_concurrency();
+	}
+	if (threads <= 1 || size < 2 * minChunkSize) {
+		if (!parseRange(data, data + size, out, NULL)) {
+			return false;
+		}
+		return validateFaces(out);
+	}
+
+	// Line aligned chunks, a few per thread so that uneven chunks still balance
+	const char * end = data + size;
+	size_t chunkCount = std::min((size_t)threads * 4, size / minChunkSize);
+	std::vector< ObjChunk > chunks(chunkCount);
+	const char * p = data;
+	for (size_t i = 0; i < chunkCount; i++) {
+		chunks[i].begin = p;
+		if (i + 1 < chunkCount) {
+			const char * target = std::max(p, data + size / chunkCount * (i + 1));
+			p = target < end ? skipLine(target, end) : end;
+		}
+		else {
+			p = end;
+		}
+		chunks[i].end = p;
+	}
+
+	runParallel(chunkCount, threads, [&](size_t i) {
+		ObjChunk & chunk = chunks[i];
+		chunk.ok = parseRange(chunk.begin, chunk.end, chunk.data, &chunk.relative);
+	});
+
+	// Where each chunk lands in the merged lists; its element counts are the base
+	// that chunk-local relative indices are resolved against
+	std::vector< size_t > offsets(4 * (chunkCount + 1), 0);
+	for (size_t i = 0; i < chunkCount; i++) {
+		if (!chunks[i].ok) {
+			return false;
+		}
+		offsets[4 * (i + 1) + 0] = offsets[4 * i + 0] + chunks[i].data.vertices.size();
+		offsets[4 * (i + 1) + 1] = offsets[4 * i + 1] + chunks[i].data.uvs.size();
+		offsets[4 * (i + 1) + 2] = offsets[4 * i + 2] + chunks[i].data.normals.size();
+		offsets[4 * (i + 1) + 3] = offsets[4 * i + 3] + chunks[i].data.faces.size();
+	}
+	out.vertices.resize(offsets[4 * chunkCount + 0]);
+	out.uvs.resize(offsets[4 * chunkCount + 1]);
+	out.normals.resize(offsets[4 * chunkCount + 2]);
+	out.faces.resize(offsets[4 * chunkCount + 3]);
+
+	runParallel(chunkCount, threads, [&](size_t i) {
+		ObjChunk & chunk = chunks[i];
+		const size_t * base = &offsets[4 * i];
+		std::copy(chunk.data.vertices.begin(), chunk.data.vertices.end(), out.vertices.begin() + base[0]);
+		std::copy(chunk.data.uvs.begin(), chunk.data.uvs.end(), out.uvs.begin() + base[1]);
+		std::copy(chunk.data.normals.begin(), chunk.data.normals.end(), out.normals.begin() + base[2]);
+		unsigned int * faces = out.faces.data() + base[3];
+		std::copy(chunk.data.faces.begin(), chunk.data.faces.end(), faces);
+		for (size_t r = 0; r < chunk.relative.size(); r++) {
+			size_t at = chunk.relative[r];
+			faces[at] += (unsigned int)base[at % 3];
+			if ((int)faces[at] <= 0) chunk.ok = false;
+		}
+		chunk.data = ObjData();
+	});
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		if (!chunks[i].ok) {
+			printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+			return false;
+		}
+	}
+	return validateFaces(out);
+}
 
 bool loadOBJ(
 	const char * path,
@@ -13,6 +384,104 @@ bool loadOBJ(
 	std::vector < glm::vec2 > & out_uvs,
 	std::vector < glm::vec3 > & out_normals
 )
+{
+	MappedFile file;
+	if (!mapFile(path, file)) {
+		printf("Impossible to open the file !\n");
+		return false;
+	}
+
+	ObjData obj;
+	bool res = parseOBJ(file.data, file.size, obj, 0);
+	unmapFile(file);
+	if (!res) {
+		return false;
+	}
+
+	// For each vertex of each triangle
+	size_t corners = obj.faces.size() / 3;
+	out_vertices.reserve(out_vertices.size() + corners);
+	out_uvs.reserve(out_uvs.size() + corners);
+	out_normals.reserve(out_normals.size() + corners);
+	for (size_t i = 0; i < obj.faces.size(); i += 3) {
+		unsigned int vertexIndex = obj.faces[i];
+		unsigned int uvIndex = obj.faces[i + 1];
+		unsigned int normalIndex = obj.faces[i + 2];
+		out_vertices.push_back(obj.vertices[vertexIndex - 1]);
+		out_uvs.push_back(uvIndex ? obj.uvs[uvIndex - 1] : glm::vec2(0.f));
+		out_normals.push_back(normalIndex ? obj.normals[normalIndex - 1] : glm::vec3(0.f));
+	}
+	return true;
+}
+
+
+void indexOBJ(
+	const ObjData & obj,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals,
+	std::vector < unsigned int > & out_indices
+)
+{
+	// Open addressing table from (v, vt, vn) to output vertex, sized for a load factor <= 0.5
+	size_t corners = obj.faces.size() / 3;
+	size_t capacity = 16;
+	while (capacity < corners * 2) capacity *= 2;
+	std::vector< unsigned int > table(capacity, ~0u);
+	std::vector< unsigned int > firstCorner;
+	firstCorner.reserve(corners / 4);
+
+	size_t base = out_vertices.size();
+	out_indices.reserve(out_indices.size() + corners);
+	for (size_t i = 0; i < corners; i++) {
+		const unsigned int * corner = &obj.faces[i * 3];
+		size_t slot = hashCorner(corner) & (capacity - 1);
+		while (table[slot] != ~0u) {
+			const unsigned int * other = &obj.faces[firstCorner[table[slot]] * 3];
+			if (other[0] == corner[0] && other[1] == corner[1] && other[2] == corner[2]) break;
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (table[slot] == ~0u) {
+			table[slot] = (unsigned int)firstCorner.size();
+			firstCorner.push_back((unsigned int)i);
+			out_vertices.push_back(obj.vertices[corner[0] - 1]);
+			out_uvs.push_back(corner[1] ? obj.uvs[corner[1] - 1] : glm::vec2(0.f));
+			out_normals.push_back(corner[2] ? obj.normals[corner[2] - 1] : glm::vec3(0.f));
+		}
+		out_indices.push_back((unsigned int)base + table[slot]);
+	}
+}
+
+bool loadOBJIndexed(
+	const char * path,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals,
+	std::vector < unsigned int > & out_indices
+)
+{
+	MappedFile file;
+	if (!mapFile(path, file)) {
+		printf("Impossible to open the file !\n");
+		return false;
+	}
+
+	ObjData obj;
+	bool res = parseOBJ(file.data, file.size, obj, 0);
+	unmapFile(file);
+	if (!res) {
+		return false;
+	}
+	indexOBJ(obj, out_vertices, out_uvs, out_normals, out_indices);
+	return true;
+}
+
+bool loadOBJLegacy(
+	const char * path,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals
+)
 {
 
 	std::vector< unsigned int > vertexIndices, uvIndices, normalIndices;
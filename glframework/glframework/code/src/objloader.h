@@ -5,9 +5,51 @@
 #include <glm\gtc\type_ptr.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 
+// Raw contents of an OBJ file. Every triangle corner stores its (v, vt, vn)
+// indices 1-based as in the file, 0 meaning the attribute is absent.
+struct ObjData {
+	std::vector < glm::vec3 > vertices;
+	std::vector < glm::vec2 > uvs;
+	std::vector < glm::vec3 > normals;
+	std::vector < unsigned int > faces;
+};
+
+// Parses an in-memory OBJ (usually a mapped file). Polygons are fan triangulated.
+// With threads > 1 the data is split into line aligned chunks parsed concurrently and
+// merged in file order, giving exactly the serial result. threads = 0 picks the
+// thread count from the file size and the number of cores.
+bool parseOBJ(const char * data, size_t size, ObjData & out, unsigned int threads = 1);
+
 bool loadOBJ(
 	const char * path,
 	std::vector < glm::vec3 > & out_vertices,
 	std::vector < glm::vec2 > & out_uvs,
 	std::vector < glm::vec3 > & out_normals
-);
\ No newline at end of file
+);
+
+// Welds the face corners of a parsed OBJ into unique vertices plus a triangle index list
+void indexOBJ(
+	const ObjData & obj,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals,
+	std::vector < unsigned int > & out_indices
+);
+
+// Welded variant: one output vertex per unique (v, vt, vn) triple, referenced by a
+// triangle index list, instead of one vertex per face corner
+bool loadOBJIndexed(
+	const char * path,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals,
+	std::vector < unsigned int > & out_indices
+);
+
+// Original fscanf based loader, only kept as the reference for benchOBJ
+bool loadOBJLegacy(
+	const char * path,
+	std::vector < glm::vec3 > & out_vertices,
+	std::vector < glm::vec2 > & out_uvs,
+	std::vector < glm::vec3 > & out_normals
+);
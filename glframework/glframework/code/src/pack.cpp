@@ -0,0 +1,124 @@
+#include "pack.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "filemap.h"
+
+namespace {
+	const char packMagic[4] = { 'P', 'A', 'C', 'K' };
+	const unsigned int packVersion = 3;
+
+	struct PackHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int entryCount;
+		unsigned int tocOffset;
+	};
+
+	MappedFile file;
+	const PackEntry * entries;
+	unsigned int entryCount;
+
+	size_t alignPack(size_t n) {
+		return (n + packAlignment - 1) & ~(size_t)(packAlignment - 1);
+	}
+
+	bool entryLess(const PackEntry & entry, const char * name) {
+		return strncmp(entry.name, name, packNameLength) < 0;
+	}
+
+	// Without the loose file (a shipped build) the entry is all there is. Only its
+	// metadata is read, so the pack still saves opening and reading the file.
+	bool stale(const PackEntry & entry, const char * name) {
+		unsigned long long size;
+		long long modified;
+		if (!statFile(name, size, modified)) {
+			return false;
+		}
+		return size != entry.sourceSize || modified != entry.sourceModified;
+	}
+}
+
+namespace Pack {
+	bool open(const char * path) {
+		close();
+		if (!mapFile(path, file)) {
+			return false;
+		}
+		const PackHeader * header = (const PackHeader *)file.data;
+		bool valid = file.size >= sizeof(PackHeader) && memcmp(header->magic, packMagic, 4) == 0 && header->version == packVersion &&
+			header->tocOffset + (unsigned long long)header->entryCount * sizeof(PackEntry) <= file.size;
+		if (valid) {
+			const PackEntry * toc = (const PackEntry *)(file.data + header->tocOffset);
+			for (unsigned int i = 0; i < header->entryCount && valid; i++) {
+				valid = toc[i].name[packNameLength - 1] == '\0' && toc[i].offset + toc[i].size <= file.size;
+			}
+		}
+		if (!valid) {
+			printf("Ignoring invalid asset pack %s\n", path);
+			unmapFile(file);
+			return false;
+		}
+		entries = (const PackEntry *)(file.data + header->tocOffset);
+		entryCount = header->entryCount;
+		printf("Asset pack %s: %u entries, %.1f KB\n", path, entryCount, file.size / 1024.f);
+		return true;
+	}
+
+	void close() {
+		unmapFile(file);
+		entries = NULL;
+		entryCount = 0;
+	}
+
+	bool find(const char * name, const char *& data, size_t & size) {
+		const PackEntry * end = entries + entryCount;
+		const PackEntry * entry = std::lower_bound(entries, end, name, entryLess);
+		if (entry == end || strncmp(entry->name, name, packNameLength) != 0) {
+			return false;
+		}
+		if (stale(*entry, name)) {
+			printf("Asset pack entry %s is older than the file, using the file\n", name);
+			return false;
+		}
+		data = file.data + entry->offset;
+		size = (size_t)entry->size;
+		return true;
+	}
+}
+
+bool writePack(const char * path, std::vector< PackSource > & sources)
+{
+	std::sort(sources.begin(), sources.end(), [](const PackSource & a, const PackSource & b) { return a.name < b.name; });
+
+	PackHeader header;
+	memcpy(header.magic, packMagic, 4);
+	header.version = packVersion;
+	header.entryCount = (unsigned int)sources.size();
+	header.tocOffset = (unsigned int)alignPack(sizeof(PackHeader));
+
+	std::vector< PackEntry > toc(sources.size());
+	size_t offset = alignPack(header.tocOffset + toc.size() * sizeof(PackEntry));
+	for (size_t i = 0; i < sources.size(); i++) {
+		if (sources[i].name.size() >= packNameLength) {
+			printf("Asset name too long for the pack: %s\n", sources[i].name.c_str());
+			return false;
+		}
+		memset(toc[i].name, 0, packNameLength);
+		memcpy(toc[i].name, sources[i].name.c_str(), sources[i].name.size());
+		toc[i].offset = offset;
+		toc[i].size = sources[i].data.size();
+		toc[i].sourceSize = sources[i].sourceSize;
+		toc[i].sourceModified = sources[i].sourceModified;
+		offset = alignPack(offset + sources[i].data.size());
+	}
+
+	std::vector< unsigned char > out(offset, 0);
+	memcpy(&out[0], &header, sizeof(header));
+	if (!toc.empty()) memcpy(&out[header.tocOffset], toc.data(), toc.size() * sizeof(PackEntry));
+	for (size_t i = 0; i < sources.size(); i++) {
+		if (!sources[i].data.empty()) memcpy(&out[(size_t)toc[i].offset], sources[i].data.data(), sources[i].data.size());
+	}
+	return writeFileAtomic(path, out.data(), out.size());
+}
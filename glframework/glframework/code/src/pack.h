@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Asset pack: a header, a table of contents sorted by name, then every blob aligned to
+// packAlignment. The runtime maps the whole file once and hands out pointers into it.
+// Shaders are stored as their source text, meshes as .meshbin blobs under the OBJ name.
+// Every entry records the size and write time of the file it was built from, so an edited
+// loose file wins over its stale entry until the packer runs again.
+const unsigned int packAlignment = 64;
+const size_t packNameLength = 48;
+
+struct PackEntry {
+	char name[packNameLength];
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned long long sourceSize;
+	long long sourceModified;
+};
+
+namespace Pack {
+	// Maps path as the pack searched by find. Returns false (and leaves loose files in
+	// use) when it is missing or invalid.
+	bool open(const char * path);
+	void close();
+	// Points data at the blob stored as name, valid until close. Returns false when there
+	// is none, or when the loose file name no longer matches the one it was built from.
+	bool find(const char * name, const char *& data, size_t & size);
+}
+
+// Used by the packer tool
+struct PackSource {
+	std::string name;
+	std::vector< unsigned char > data;
+	unsigned long long sourceSize;
+	long long sourceModified;
+};
+
+bool writePack(const char * path, std::vector< PackSource > & sources);
@@ -1,24 +1,36 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <ctime>
 #include <time.h>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <cstddef>
+#include <chrono>
 
 #include <GL\glew.h>
 #include <glm\gtc\type_ptr.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 #include <cstdio>
 #include <cassert>
+#include <cfloat>
 
 #include <imgui\imgui.h>
 #include <imgui\imgui_impl_sdl_gl3.h>
 
 #include "GL_framework.h"
 
-#include "objloader.h"
+#include "meshcache.h"
+#include "assets.h"
+#include "culling.h"
+#include "geometryarena.h"
+#include "glstate.h"
+#include "multidraw.h"
+#include "pack.h"
+#include "renderqueue.h"
+#include "shader.h"
 
 ///////// fw decl
 namespace ImGui {
@@ -46,6 +58,50 @@ namespace RenderVars {
 	bool firstTime, secondTime, init;
 	double start;
 
+	// Startup timings, from the beginning of GLinit
+	std::chrono::steady_clock::time_point initStart;
+	double timeToFirstFrame = -1.0;
+	double timeToFullScene = -1.0;
+	int meshesLoading = 0;
+	int programsPending = -1;
+
+	// LOD selection and the per-frame LOD distribution shown in the GUI
+	int height;
+	float lodPixelError = 1.f;
+	int lodDraws[maxMeshLods];
+	int lodTriangles;
+
+	// How the scene is submitted: every mesh drawn by itself, the gondolas instanced, or the
+	// flat meshes in one multi-draw indirect batch (GL 4.3, per draw until it is ready)
+	enum DrawPath {
+		PathPerDraw,
+		PathInstanced,
+		PathMultiDraw,
+	};
+	int drawPath = PathInstanced;
+	// Frustum culling of the multi-draw batch in a compute pass, and whether this frame does it
+	bool gpuCulling = true;
+	bool gpuCulled;
+
+	// Gondolas around the wheel, and the CPU time spent placing and submitting them
+	const int maxGondolas = 20000;
+	int gondolaCount = 20;
+	double gondolaSubmitSeconds;
+
+	// Binds and flag changes of the last frame, issued and skipped by GLState
+	GLState::Counters glCalls;
+	RenderQueue::Stats queue;
+
+	// Meshlet culling of the large structures and what it saved this frame
+	bool clusterCulling = true;
+	int clustersDrawn, clustersFrustumCulled, clustersConeCulled;
+	int clusterTriangles, clusterTrianglesTotal;
+
+	// Whole objects, gondola instances included, frustum culled on the CPU this frame
+	bool objectCulling = true;
+	int objectsVisible, objectsCulled;
+	int objectsGpuCandidates;	// left to the multi-draw compute pass instead
+
 	glm::mat4 _projection;
 	glm::mat4 _modelView;
 	glm::mat4 _MVP;
@@ -65,6 +121,7 @@ namespace RV = RenderVars;
 
 void GLResize(int width, int height) {
 	glViewport(0, 0, width, height);
+	RV::height = height;
 	if (height != 0) RV::_projection = glm::perspective(RV::FOV, (float)width / (float)height, RV::zNear, RV::zFar);
 	else RV::_projection = glm::perspective(RV::FOV, 0.f, RV::zNear, RV::zFar);
 }
@@ -97,56 +154,233 @@ void GLmousecb(MouseEvent ev) {
 }
 
 //////////////////////////////////////////////////
-GLuint compileShader(GLenum shaderType, std::string shaderName, const char* name = "") {
+GLenum meshIndexType(const Mesh & mesh) {
+	return mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
 
-	std::stringstream stream;
-	std::string string;
+// Offset into the arena index buffer of the firstIndex-th index of mesh
+const void * meshIndices(const Mesh & mesh, unsigned int firstIndex) {
+	return (const void *)(GeometryArena::indexOffset(mesh.geometry) + (size_t)firstIndex * mesh.indexSize);
+}
 
-	std::ifstream myFile(shaderName);
-	if (myFile.is_open())
-	{
-		stream << myFile.rdbuf();
-		myFile.close();
-		string = stream.str();
+// Attribute locations every mesh program is linked with
+const char * meshAttributes[] = { "in_Position", "in_Normal" };
+
+// Coarsest LOD whose simplification error projects to at most RV::lodPixelError pixels
+unsigned int selectMeshLod(const Mesh & mesh, const glm::mat4 & objMat) {
+	glm::vec3 extent = mesh.boundsMax - mesh.boundsMin;
+	glm::vec4 center = RV::_modelView * objMat * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.f);
+	float distance = glm::max(-center.z - glm::length(extent) * 0.5f, RV::zNear);
+	float pixelsPerUnit = RV::_projection[1][1] * 0.5f * RV::height / distance;
+	float size = glm::max(extent.x, glm::max(extent.y, extent.z)) * pixelsPerUnit;
+
+	unsigned int lod = 0;
+	while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * size <= RV::lodPixelError) lod++;
+	return lod;
+}
+
+// LOD to draw mesh at, counted in the LOD stats of the frame
+unsigned int countMeshLod(const Mesh & mesh, const glm::mat4 & objMat) {
+	unsigned int lod = selectMeshLod(mesh, objMat);
+	RV::lodDraws[lod]++;
+	RV::lodTriangles += mesh.lods[lod].indexCount / 3;
+	return lod;
+}
+
+void drawMesh(const Mesh & mesh, const glm::mat4 & objMat) {
+	unsigned int lod = countMeshLod(mesh, objMat);
+	glDrawElementsBaseVertex(GL_TRIANGLES, mesh.lods[lod].indexCount, meshIndexType(mesh), meshIndices(mesh, mesh.lods[lod].firstIndex), GeometryArena::baseVertex(mesh.geometry));
+}
+
+// Full detail draws go through the meshlets, culling those outside the frustum or facing
+// away from the camera. Fills the index ranges left, merging consecutive meshlets, or
+// returns false when the mesh is to be drawn whole at its LOD instead.
+bool cullMeshClusters(const Mesh & mesh, const glm::mat4 & objMat, std::vector< GLsizei > & counts, std::vector< unsigned int > & firstIndices) {
+	if (!RV::clusterCulling || mesh.meshletCount == 0 || selectMeshLod(mesh, objMat) != 0) return false;
+
+	counts.clear();
+	firstIndices.clear();
+
+	// Culling happens in object space
+	glm::mat4 viewObj = RV::_modelView * objMat;
+	Frustum frustum = extractFrustum(RV::_projection * viewObj);
+	glm::vec3 camera = glm::vec3(glm::inverse(viewObj)[3]);
+	int triangles = 0;
+	for (unsigned int i = 0; i < mesh.meshletCount; i++) {
+		const Meshlet & meshlet = mesh.meshlets[i];
+		RV::clusterTrianglesTotal += meshlet.indexCount / 3;
+		if (!sphereInFrustum(frustum, glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]), meshlet.radius)) {
+			RV::clustersFrustumCulled++;
+			continue;
+		}
+		if (meshletBackfacing(meshlet, camera)) {
+			RV::clustersConeCulled++;
+			continue;
+		}
+		if (!counts.empty() && firstIndices.back() + counts.back() == meshlet.firstIndex) counts.back() += meshlet.indexCount;
+		else {
+			counts.push_back(meshlet.indexCount);
+			firstIndices.push_back(meshlet.firstIndex);
+		}
+		RV::clustersDrawn++;
+		triangles += meshlet.indexCount / 3;
 	}
 
-	const GLchar * shaderStr = string.c_str();
-
-	GLuint shader = glCreateShader(shaderType);
-	glShaderSource(shader, 1, &shaderStr, NULL);
-	glCompileShader(shader);
-	GLint res;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &res);
-	if (res == GL_FALSE) {
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &res);
-		char *buff = new char[res];
-		glGetShaderInfoLog(shader, res, &res, buff);
-		fprintf(stderr, "Error Shader %s: %s", name, buff);
-		delete[] buff;
-		glDeleteShader(shader);
-		return 0;
+	RV::lodDraws[0]++;
+	RV::lodTriangles += triangles;
+	RV::clusterTriangles += triangles;
+	return true;
+}
+
+// What is left after culling goes in one glMultiDrawElementsBaseVertex
+void drawMeshClusters(const Mesh & mesh, const glm::mat4 & objMat) {
+	static std::vector< GLsizei > counts;
+	static std::vector< unsigned int > firstIndices;
+	static std::vector< const void * > offsets;
+	static std::vector< GLint > baseVertices;
+	if (!cullMeshClusters(mesh, objMat, counts, firstIndices)) {
+		drawMesh(mesh, objMat);
+		return;
 	}
-	return shader;
+	if (counts.empty()) return;
+
+	offsets.resize(counts.size());
+	for (size_t i = 0; i < counts.size(); i++) offsets[i] = meshIndices(mesh, firstIndices[i]);
+	baseVertices.assign(counts.size(), GeometryArena::baseVertex(mesh.geometry));
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), meshIndexType(mesh), offsets.data(), (GLsizei)counts.size(), baseVertices.data());
 }
-void linkProgram(GLuint program) {
-	glLinkProgram(program);
-	GLint res;
-	glGetProgramiv(program, GL_LINK_STATUS, &res);
-	if (res == GL_FALSE) {
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &res);
-		char *buff = new char[res];
-		glGetProgramInfoLog(program, res, &res, buff);
-		fprintf(stderr, "Error Link: %s", buff);
-		delete[] buff;
+
+// Object space bounding sphere of the whole mesh
+glm::vec4 meshSphere(const Mesh & mesh) {
+	return glm::vec4(mesh.boundsCenter, mesh.boundsRadius);
+}
+
+// The same sphere once mesh is placed at objMat, into the culling set of the frame
+void addMeshSphere(SphereSet & spheres, const Mesh & mesh, const glm::mat4 & objMat) {
+	float scale = glm::max(glm::length(glm::vec3(objMat[0])), glm::max(glm::length(glm::vec3(objMat[1])), glm::length(glm::vec3(objMat[2]))));
+	addSphere(spheres, glm::vec3(objMat * glm::vec4(mesh.boundsCenter, 1.f)), mesh.boundsRadius * scale);
+}
+
+// The same selection, as commands of the multi-draw batch. When the GPU culls, meshlets are
+// only split out, every one of them a candidate with its own sphere.
+void multiDrawMesh(const Mesh & mesh, const glm::mat4 & objMat, const glm::vec3 & color, bool clusters) {
+	static std::vector< GLsizei > counts;
+	static std::vector< unsigned int > firstIndices;
+	if (RV::gpuCulled) {
+		if (clusters && RV::clusterCulling && mesh.meshletCount > 0 && selectMeshLod(mesh, objMat) == 0) {
+			RV::lodDraws[0]++;
+			for (unsigned int i = 0; i < mesh.meshletCount; i++) {
+				const Meshlet & meshlet = mesh.meshlets[i];
+				glm::vec4 sphere(meshlet.center[0], meshlet.center[1], meshlet.center[2], meshlet.radius);
+				MultiDraw::add(mesh, meshlet.firstIndex, meshlet.indexCount, objMat, color, sphere);
+				RV::lodTriangles += meshlet.indexCount / 3;
+			}
+			return;
+		}
+	}
+	else if (clusters && cullMeshClusters(mesh, objMat, counts, firstIndices)) {
+		for (size_t i = 0; i < counts.size(); i++) MultiDraw::add(mesh, firstIndices[i], counts[i], objMat, color, meshSphere(mesh));
+		return;
+	}
+	unsigned int lod = countMeshLod(mesh, objMat);
+	MultiDraw::add(mesh, mesh.lods[lod].firstIndex, mesh.lods[lod].indexCount, objMat, color, meshSphere(mesh));
+}
+
+void drawMeshItem(const RenderQueue::DrawItem & item) {
+	drawMesh(*item.mesh, item.objMat);
+}
+
+void drawMeshClustersItem(const RenderQueue::DrawItem & item) {
+	drawMeshClusters(*item.mesh, item.objMat);
+}
+
+// Depth of the sort key, the view distance of a point over the far plane
+float queueDepth(const glm::vec4 & point) {
+	return -(RV::_modelView * point).z / RV::zFar;
+}
+
+// Meshes drawn with this program, the flat one most objects share, join the multi-draw
+// batch on that path; MultiDrawVert.txt does the same from per-draw data
+ShaderProgram * flatProgram;
+
+// Whether meshes drawn with program join the multi-draw batch this frame
+bool multiDrawn(ShaderProgram * program) {
+	return RV::drawPath == RV::PathMultiDraw && program == flatProgram && MultiDraw::ready();
+}
+
+// Queues a flat coloured mesh, sorted front to back by the distance of its centre
+void submitMesh(ShaderProgram * program, const Mesh & mesh, const glm::mat4 & objMat, const glm::vec4 & color, RenderQueue::DrawFunction draw) {
+	if (multiDrawn(program)) {
+		multiDrawMesh(mesh, objMat, glm::vec3(color), draw == drawMeshClustersItem);
+		return;
+	}
+	RenderQueue::DrawItem item;
+	item.program = program;
+	item.vao = GeometryArena::vertexArray();
+	item.mesh = &mesh;
+	item.objMat = objMat;
+	item.color = glm::vec3(color);
+	item.uniforms = RenderQueue::SetObjMat | RenderQueue::SetMesh | RenderQueue::SetColor;
+	item.draw = draw;
+	float depth = queueDepth(objMat * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.f));
+	item.key = RenderQueue::makeKey(RenderQueue::PassOpaque, program->id, item.vao, RenderQueue::colorMaterial(item.color), depth);
+	RenderQueue::push(item);
+}
+
+// Meshes queued this frame, held back until cullQueuedMeshes has tested them all at once
+namespace Culling {
+	struct QueuedMesh {
+		ShaderProgram * program;
+		const Mesh * mesh;
+		glm::mat4 objMat;
+		glm::vec4 color;
+		RenderQueue::DrawFunction draw;
+	};
+	std::vector< QueuedMesh > meshes;
+	SphereSet spheres;
+	std::vector< unsigned char > visible;
+}
+
+void queueMesh(ShaderProgram * program, const Mesh & mesh, const glm::mat4 & objMat, const glm::vec4 & color, RenderQueue::DrawFunction draw) {
+	// The compute pass tests these itself, a CPU test first would only repeat it
+	if (RV::gpuCulled && multiDrawn(program)) {
+		RV::objectsGpuCandidates++;
+		submitMesh(program, mesh, objMat, color, draw);
+		return;
 	}
+	Culling::QueuedMesh queued = { program, &mesh, objMat, color, draw };
+	Culling::meshes.push_back(queued);
+	addMeshSphere(Culling::spheres, mesh, objMat);
+}
+
+// Frustum culls the bounding spheres of everything queued against the planes of RV::_MVP
+// and submits what is left
+void cullQueuedMeshes() {
+	size_t count = Culling::meshes.size();
+	if (RV::objectCulling) {
+		int visible = cullSpheres(extractFrustum(RV::_MVP), Culling::spheres, Culling::visible);
+		RV::objectsVisible += visible;
+		RV::objectsCulled += (int)count - visible;
+	}
+	else {
+		Culling::visible.assign(count, 1);
+		RV::objectsVisible += (int)count;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (!Culling::visible[i]) continue;
+		const Culling::QueuedMesh & queued = Culling::meshes[i];
+		submitMesh(queued.program, *queued.mesh, queued.objMat, queued.color, queued.draw);
+	}
+	Culling::meshes.clear();
+	clearSpheres(Culling::spheres);
 }
 
 ////////////////////////////////////////////////// AXIS
 namespace Axis {
 	GLuint AxisVao;
 	GLuint AxisVbo[3];
-	GLuint AxisShader[2];
-	GLuint AxisProgram;
+	ShaderProgram * AxisProgram;
 
 	float AxisVerts[] = {
 		0.0, 0.0, 0.0,
@@ -174,70 +408,60 @@ namespace Axis {
 
 	void setupAxis() {
 		glGenVertexArrays(1, &AxisVao);
-		glBindVertexArray(AxisVao);
+		GLState::bindVertexArray(AxisVao);
 		glGenBuffers(3, AxisVbo);
 
-		glBindBuffer(GL_ARRAY_BUFFER, AxisVbo[0]);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, AxisVbo[0]);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 24, AxisVerts, GL_STATIC_DRAW);
 		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		glEnableVertexAttribArray(0);
 
-		glBindBuffer(GL_ARRAY_BUFFER, AxisVbo[1]);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, AxisVbo[1]);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 24, AxisColors, GL_STATIC_DRAW);
 		glVertexAttribPointer((GLuint)1, 4, GL_FLOAT, false, 0, 0);
 		glEnableVertexAttribArray(1);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, AxisVbo[2]);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, AxisVbo[2]);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLubyte) * 6, AxisIdx, GL_STATIC_DRAW);
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-		AxisShader[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "AxisVert");
-		AxisShader[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "AxisFrag");
-
-		AxisProgram = glCreateProgram();
-		glAttachShader(AxisProgram, AxisShader[0]);
-		glAttachShader(AxisProgram, AxisShader[1]);
-		glBindAttribLocation(AxisProgram, 0, "in_Position");
-		glBindAttribLocation(AxisProgram, 1, "in_Color");
-		linkProgram(AxisProgram);
+		const char * attributes[] = { "in_Position", "in_Color" };
+		AxisProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", attributes, 2);
 	}
 	void cleanupAxis() {
-		glDeleteBuffers(3, AxisVbo);
-		glDeleteVertexArrays(1, &AxisVao);
+		GLState::deleteBuffers(3, AxisVbo);
+		GLState::deleteVertexArrays(1, &AxisVao);
 
-		glDeleteProgram(AxisProgram);
-		glDeleteShader(AxisShader[0]);
-		glDeleteShader(AxisShader[1]);
+		releaseProgram(AxisProgram);
+		AxisProgram = NULL;
 	}
-	void drawAxis() {
-		glBindVertexArray(AxisVao);
-		glUseProgram(AxisProgram);
-		glUniformMatrix4fv(glGetUniformLocation(AxisProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RV::_MVP));
+	void drawAxisItem(const RenderQueue::DrawItem & item) {
 		glDrawElements(GL_LINES, 6, GL_UNSIGNED_BYTE, 0);
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+	}
+	void drawAxis() {
+		RenderQueue::DrawItem item = {};
+		item.program = AxisProgram;
+		item.vao = AxisVao;
+		item.draw = drawAxisItem;
+		item.key = RenderQueue::makeKey(RenderQueue::PassOpaque, AxisProgram->id, AxisVao, 0, 0.f);
+		RenderQueue::push(item);
 	}
 }
 
 
 namespace Luz {
 
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 	glm::vec3 position;
 	glm::vec4 lightColor = { 1.f, 1.f, 0.f, 0.f };
 	float angle;
 	float rotationX;
 	bool goingRight;
-	GLuint luzVao;
-	GLuint luzVbo[3];
-	GLuint luzShaders[2];
-	GLuint luzProgram;
+	ShaderProgram * luzProgram;
 
 	glm::mat4 luzMat = glm::mat4(1.f);
 	glm::vec4 luzColor = { 1.f, 1.f, 0.f, 0.f };
@@ -245,36 +469,14 @@ namespace Luz {
 	char* luz_vertShader;
 	char* luz_fragShader;
 
-	void setupLuz() {
-		glBufferData(GL_ARRAY_BUFFER, Luz::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &luzVao);
-		glBindVertexArray(luzVao);
-		glGenBuffers(2, luzVbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, luzVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, luzVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
-
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		luzShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-		luzShaders[1] = compileShader( GL_FRAGMENT_SHADER,"BasicFrag.txt", "cubeFrag");
+	// Copies the mesh into the geometry arena once it has finished loading
+	void uploadLuz() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+	}
 
-		luzProgram = glCreateProgram();
-		glAttachShader(luzProgram, luzShaders[0]);
-		glAttachShader(luzProgram, luzShaders[1]);
-		glBindAttribLocation(luzProgram, 0, "in_Position");
-		glBindAttribLocation(luzProgram, 1, "in_Normal");
-		linkProgram(luzProgram);
+	void setupLuz() {
+		luzProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
 		if (RV::init)
 		{
 			luzMat = glm::translate(luzMat, glm::vec3(5.55f, 6.3f, .0f));
@@ -288,28 +490,20 @@ namespace Luz {
 	}
 
 	void cleanupLuz() {
-		glDeleteBuffers(2, luzVbo);
-		glDeleteVertexArrays(1, &luzVao);
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			mesh.geometry = 0;
+		}
 
-		glDeleteProgram(luzProgram);
-		glDeleteShader(luzShaders[0]);
-		glDeleteShader(luzShaders[1]);
+		releaseProgram(luzProgram);
+		luzProgram = NULL;
 	}
 
 	void drawLuz(float currentTime) {
 
-		glBindVertexArray(luzVao);
-		glUseProgram(luzProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(luzProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(luzMat));
-		glUniformMatrix4fv(glGetUniformLocation(luzProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(luzProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(luzProgram, "color"), luzColor[0], luzColor[1], luzColor[2]);
-		glDrawArrays(GL_TRIANGLES, 0, Luz::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+		if (mesh.geometry == 0) return;
 
+		queueMesh(luzProgram, mesh, luzMat, luzColor, drawMeshItem);
 	}
 
 }
@@ -318,16 +512,13 @@ namespace Luz {
 ////////////////////////////////////////////////// GALLINA
 namespace Gallina {
 
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 	float lastX;
 	float lastY;
 	float angle;
-	GLuint gallinaVao;
-	GLuint gallinaVbo[3];
-	GLuint gallinaShaders[2];
-	GLuint gallinaProgram;
+	ShaderProgram * gallinaProgram;
+	ShaderProgram * gallinaVariants[2];	// flat for exercise 1, lit for exercise 2
 
 	glm::mat4 gallinaMat = glm::mat4(1.f);
 	glm::vec4 gallinaColor = { 0.1f, 1.f, 1.f, 0.f };
@@ -335,44 +526,21 @@ namespace Gallina {
 	char* gallina_vertShader;
 	char* gallina_fragShader;
 
-	void setupGallina() {
-		glBufferData(GL_ARRAY_BUFFER, Gallina::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &gallinaVao);
-		glBindVertexArray(gallinaVao);
-		glGenBuffers(2, gallinaVbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, gallinaVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
+	// Copies the mesh into the geometry arena once it has finished loading
+	void uploadGallina() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, gallinaVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
+	void selectGallinaVariant(int exercise) {
+		gallinaProgram = gallinaVariants[exercise - 1];
+	}
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		if (ImGui::exercise1 == 1)
-		{
-			gallinaShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-			gallinaShaders[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "cubeFrag");
-		}
-		else if (ImGui::exercise2 == 1)
-		{
-			gallinaShaders[0] = compileShader(GL_VERTEX_SHADER, "GallinaVert.txt", "cubeVert");
-			gallinaShaders[1] = compileShader(GL_FRAGMENT_SHADER, "GallinaFrag.txt", "cubeFrag");
-		}
-		
-
-		gallinaProgram = glCreateProgram();
-		glAttachShader(gallinaProgram, gallinaShaders[0]);
-		glAttachShader(gallinaProgram, gallinaShaders[1]);
-		glBindAttribLocation(gallinaProgram, 0, "in_Position");
-		glBindAttribLocation(gallinaProgram, 1, "in_Normal");
-		linkProgram(gallinaProgram);
+	// Both variants are linked up front so switching exercise only swaps the handle
+	void setupGallina() {
+		gallinaVariants[0] = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
+		gallinaVariants[1] = acquireProgramAsync("PhongVert.txt", "PhongFrag.txt", meshAttributes, 2, "SECOND_LIGHT");
+		selectGallinaVariant(ImGui::exercise2 == 1 ? 2 : 1);
 		if (RV::init)
 		{
 			gallinaMat = glm::rotate(gallinaMat, (float)glm::radians(90.0f), glm::vec3(0, 1, 0));
@@ -384,37 +552,22 @@ namespace Gallina {
 	}
 
 	void cleanupGallina() {
-		glDeleteBuffers(2, gallinaVbo);
-		glDeleteVertexArrays(1, &gallinaVao);
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			mesh.geometry = 0;
+		}
 
-		glDeleteProgram(gallinaProgram);
-		glDeleteShader(gallinaShaders[0]);
-		glDeleteShader(gallinaShaders[1]);
+		releaseProgram(gallinaVariants[0]);
+		releaseProgram(gallinaVariants[1]);
+		gallinaVariants[0] = gallinaVariants[1] = NULL;
+		gallinaProgram = NULL;
 	}
 
 	void drawGallina(float currentTime) {
 
-		glBindVertexArray(gallinaVao);
-		glUseProgram(gallinaProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(gallinaProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(gallinaMat));
-		glUniformMatrix4fv(glGetUniformLocation(gallinaProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(gallinaProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(gallinaProgram, "light_Position"), ImGui::lightPosition[0], ImGui::lightPosition[1], ImGui::lightPosition[2]);
-		glUniform3f(glGetUniformLocation(gallinaProgram, "light_Position2"), Luz::position[0] + Luz::rotationX/100, Luz::position[1], Luz::position[2]);
-		glUniform3f(glGetUniformLocation(gallinaProgram, "color"), gallinaColor[0], gallinaColor[1], gallinaColor[2]);
-		glUniform3f(glGetUniformLocation(gallinaProgram, "light_Color"), ImGui::lightColor[0], ImGui::lightColor[1], ImGui::lightColor[2]);
-		glUniform3f(glGetUniformLocation(gallinaProgram, "light_Color2"), Luz::lightColor[0], Luz::lightColor[1], Luz::lightColor[2]);
-		glUniformMatrix4fv(glGetUniformLocation(gallinaProgram, "camera_Point"), 1, GL_FALSE, glm::value_ptr(RenderVars::_cameraPoint));
-		glUniform1f(glGetUniformLocation(gallinaProgram, "kd"), ImGui::Diffuse);
-		glUniform1f(glGetUniformLocation(gallinaProgram, "ka"), ImGui::Ambient);
-		glUniform1f(glGetUniformLocation(gallinaProgram, "ks"), ImGui::Specular);
-		glUniform1f(glGetUniformLocation(gallinaProgram, "light_Power"), ImGui::LightPower);
-		//glUniform4f(glGetUniformLocation(gallinaProgram, "Color"), gallinaColor[0], gallinaColor[1], gallinaColor[2], gallinaColor[3]);
-		glDrawArrays(GL_TRIANGLES, 0, Gallina::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+		if (mesh.geometry == 0) return;
+
+		queueMesh(gallinaProgram, mesh, gallinaMat, gallinaColor, drawMeshItem);
 	}
 
 }
@@ -422,16 +575,13 @@ namespace Gallina {
 ////////////////////////////////////////////////// TRUMP
 namespace Trump {
 
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 	float lastX;
 	float lastY;
 	float angle;
-	GLuint trumpVao;
-	GLuint trumpVbo[3];
-	GLuint trumpShaders[2];
-	GLuint trumpProgram;
+	ShaderProgram * trumpProgram;
+	ShaderProgram * trumpVariants[2];	// flat for exercise 1, lit for exercise 2
 
 	glm::mat4 trumpMat = glm::mat4(1.f);
 	glm::vec4 trumpColor = { 1.0f, 0.f, 0.f, 0.f };
@@ -439,44 +589,21 @@ namespace Trump {
 	char* trump_vertShader;
 	char* trump_fragShader;
 
-	void setupTrump() {
-		glBufferData(GL_ARRAY_BUFFER, Trump::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &trumpVao);
-		glBindVertexArray(trumpVao);
-		glGenBuffers(2, trumpVbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, trumpVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, trumpVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
-
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// Copies the mesh into the geometry arena once it has finished loading
+	void uploadTrump() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+	}
 
-		if (ImGui::exercise1 == 1)
-		{
-			trumpShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-			trumpShaders[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "cubeFrag");
-		}
-		else if (ImGui::exercise2 == 1)
-		{
-			trumpShaders[0] = compileShader(GL_VERTEX_SHADER, "TrumpVert.txt", "cubeVert");
-			trumpShaders[1] = compileShader(GL_FRAGMENT_SHADER, "TrumpFrag.txt", "cubeFrag");
-		}
+	void selectTrumpVariant(int exercise) {
+		trumpProgram = trumpVariants[exercise - 1];
+	}
 
-		trumpProgram = glCreateProgram();
-		glAttachShader(trumpProgram, trumpShaders[0]);
-		glAttachShader(trumpProgram, trumpShaders[1]);
-		glBindAttribLocation(trumpProgram, 0, "in_Position");
-		glBindAttribLocation(trumpProgram, 1, "in_Normal");
-		linkProgram(trumpProgram);
+	// Both variants are linked up front so switching exercise only swaps the handle
+	void setupTrump() {
+		trumpVariants[0] = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
+		trumpVariants[1] = acquireProgramAsync("PhongVert.txt", "PhongFrag.txt", meshAttributes, 2, "SECOND_LIGHT TOON_STEPS");
+		selectTrumpVariant(ImGui::exercise2 == 1 ? 2 : 1);
 		if (RV::init)
 		{
 			trumpMat = glm::rotate(trumpMat, (float)glm::radians(180.0f), glm::vec3(0, 1, 0));
@@ -487,56 +614,48 @@ namespace Trump {
 	}
 
 	void cleanupTrump() {
-		glDeleteBuffers(2, trumpVbo);
-		glDeleteVertexArrays(1, &trumpVao);
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			mesh.geometry = 0;
+		}
 
-		glDeleteProgram(trumpProgram);
-		glDeleteShader(trumpShaders[0]);
-		glDeleteShader(trumpShaders[1]);
+		releaseProgram(trumpVariants[0]);
+		releaseProgram(trumpVariants[1]);
+		trumpVariants[0] = trumpVariants[1] = NULL;
+		trumpProgram = NULL;
 	}
 
 	void drawTrump(float currentTime) {
 
-		glBindVertexArray(trumpVao);
-		glUseProgram(trumpProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(trumpProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(trumpMat));
-		glUniformMatrix4fv(glGetUniformLocation(trumpProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(trumpProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(trumpProgram, "light_Position"), ImGui::lightPosition[0], ImGui::lightPosition[1], ImGui::lightPosition[2]);
-		glUniform3f(glGetUniformLocation(trumpProgram, "light_Position2"), Luz::position[0] + Luz::rotationX / 100, Luz::position[1], Luz::position[2]);
-		glUniform3f(glGetUniformLocation(trumpProgram, "light_Position2"), Luz::position[0], Luz::position[1], Luz::position[2]);
-		glUniform3f(glGetUniformLocation(trumpProgram, "color"), trumpColor[0], trumpColor[1], trumpColor[2]);
-		glUniform3f(glGetUniformLocation(trumpProgram, "light_Color"), ImGui::lightColor[0], ImGui::lightColor[1], ImGui::lightColor[2]);
-		glUniform3f(glGetUniformLocation(trumpProgram, "light_Color2"), Luz::lightColor[0], Luz::lightColor[1], Luz::lightColor[2]);
-		glUniformMatrix4fv(glGetUniformLocation(trumpProgram, "camera_Point"), 1, GL_FALSE, glm::value_ptr(RenderVars::_cameraPoint));
-		glUniform1f(glGetUniformLocation(trumpProgram, "kd"), ImGui::Diffuse);
-		glUniform1f(glGetUniformLocation(trumpProgram, "ka"), ImGui::Ambient);
-		glUniform1f(glGetUniformLocation(trumpProgram, "ks"), ImGui::Specular);
-		glUniform1f(glGetUniformLocation(trumpProgram, "light_Power"), ImGui::LightPower);
-		glDrawArrays(GL_TRIANGLES, 0, Trump::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+		if (mesh.geometry == 0) return;
 
+		queueMesh(trumpProgram, mesh, trumpMat, trumpColor, drawMeshItem);
 	}
 
 }
 
 ////////////////////////////////////////////////// CABINA
 namespace Cabina {
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 	float lastX;
 	float lastY;
 	float mainX;
 	float mainY;
 	float angle;
-	GLuint cabinaVao;
-	GLuint cabinaVbo[3];
-	GLuint cabinaShaders[2];
-	GLuint cabinaProgram;
+	ShaderProgram * cabinaProgram;
+
+	// Instanced path: one object matrix per gondola, streamed every frame
+	GLuint instanceVao;
+	GLuint instanceVbo;
+	ShaderProgram * instancedProgram;
+	std::vector< glm::mat4 > instances;
+	// Those left after frustum culling, what the instance buffer holds
+	SphereSet instanceSpheres;
+	std::vector< unsigned char > instanceVisible;
+	std::vector< glm::mat4 > visibleInstances;
+	unsigned int instancedLod;
+	const char * instancedAttributes[] = { "in_Position", "in_Normal", "in_UV", "in_ObjMat" };
 
 	glm::mat4 cabinaMat = glm::mat4(1.f);
 	glm::vec4 cabinaColor = { 0.0f, 1.f, 0.1f, 0.f };
@@ -544,37 +663,29 @@ namespace Cabina {
 	char* cabina_vertShader;
 	char* cabina_fragShader;
 
-	void setupCabina() {
-		glBufferData(GL_ARRAY_BUFFER, Cabina::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &cabinaVao);
-		glBindVertexArray(cabinaVao);
-		glGenBuffers(2, cabinaVbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, cabinaVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, cabinaVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
-
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		cabinaShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-		cabinaShaders[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "cubeFrag");
-
+	// Copies the mesh into the geometry arena once it has finished loading, and builds the
+	// instanced VAO on top of it
+	void uploadCabina() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+
+		// Same arena layout plus in_ObjMat at locations 3 to 6, a column each, advancing once per instance
+		instanceVao = GeometryArena::createVertexArray();
+		glGenBuffers(1, &instanceVbo);
+		GLState::bindVertexArray(instanceVao);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		for (GLuint column = 0; column < 4; column++) {
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribDivisor(3 + column, 1);
+		}
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-		cabinaProgram = glCreateProgram();
-		glAttachShader(cabinaProgram, cabinaShaders[0]);
-		glAttachShader(cabinaProgram, cabinaShaders[1]);
-		glBindAttribLocation(cabinaProgram, 0, "in_Position");
-		glBindAttribLocation(cabinaProgram, 1, "in_Normal");
-		linkProgram(cabinaProgram);
+	void setupCabina() {
+		cabinaProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
+		instancedProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", instancedAttributes, 4, "INSTANCED");
 		cabinaMat = glm::translate(cabinaMat, glm::vec3(5.55f, 6.3f, .0f));
 		lastX = 5.55f;
 		lastY = 6.3f;
@@ -584,34 +695,86 @@ namespace Cabina {
 	}
 
 	void cleanupCabina() {
-		glDeleteBuffers(2, cabinaVbo);
-		glDeleteVertexArrays(1, &cabinaVao);
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			GeometryArena::deleteVertexArray(instanceVao);
+			GLState::deleteBuffers(1, &instanceVbo);
+			mesh.geometry = 0;
+		}
 
-		glDeleteProgram(cabinaProgram);
-		glDeleteShader(cabinaShaders[0]);
-		glDeleteShader(cabinaShaders[1]);
+		releaseProgram(cabinaProgram);
+		releaseProgram(instancedProgram);
+		cabinaProgram = NULL;
+		instancedProgram = NULL;
+	}
+
+	// Spreads count gondolas evenly around the wheel, starting at angle
+	void placeCabinas(int count) {
+		if (angle >= 360) angle -= 360;
+		instances.resize(count);
+		for (int i = 0; i < count; i++) {
+			float a = glm::radians(angle + i * 360.f / count);
+			instances[i] = glm::translate(glm::mat4(1.f), glm::vec3(cos(a) * 5.55f, sin(a) * 5.55f + 6.3f, 0.f));
+		}
+		lastX = instances[count - 1][3].x;
+		lastY = instances[count - 1][3].y;
 	}
 
 	void drawCabina(float currentTime) {
 
-		glBindVertexArray(cabinaVao);
-		glUseProgram(cabinaProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(cabinaProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(cabinaMat));
-		glUniformMatrix4fv(glGetUniformLocation(cabinaProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(cabinaProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(cabinaProgram, "light_Position"), ImGui::lightPosition[0] + Luz::rotationX / 100, ImGui::lightPosition[1], ImGui::lightPosition[2]);
-		glUniform3f(glGetUniformLocation(cabinaProgram, "color"), cabinaColor[0], cabinaColor[1], cabinaColor[2]);
-		glUniform3f(glGetUniformLocation(cabinaProgram, "light_Color"), ImGui::lightColor[0], ImGui::lightColor[1], ImGui::lightColor[2]);
-		glUniformMatrix4fv(glGetUniformLocation(cabinaProgram, "camera_Point"), 1, GL_FALSE, glm::value_ptr(RenderVars::_cameraPoint));
-		glUniform1f(glGetUniformLocation(cabinaProgram, "kd"), ImGui::Diffuse);
-		glUniform1f(glGetUniformLocation(cabinaProgram, "ka"), ImGui::Ambient);
-		glUniform1f(glGetUniformLocation(cabinaProgram, "ks"), ImGui::Specular);
-		glUniform1f(glGetUniformLocation(cabinaProgram, "light_Power"), ImGui::LightPower);
-		glDrawArrays(GL_TRIANGLES, 0, Cabina::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+		if (mesh.geometry == 0) return;
+
+		queueMesh(cabinaProgram, mesh, cabinaMat, cabinaColor, drawMeshItem);
+	}
+
+	void drawCabinasItem(const RenderQueue::DrawItem & item) {
+		const MeshLod & lod = mesh.lods[instancedLod];
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, meshIndexType(mesh), meshIndices(mesh, lod.firstIndex), (GLsizei)visibleInstances.size(), GeometryArena::baseVertex(mesh.geometry));
+	}
+
+	// Gondolas inside the frustum in one instanced draw, at the LOD the nearest one needs
+	void drawCabinasInstanced() {
+
+		if (mesh.geometry == 0 || instances.empty()) return;
+
+		clearSpheres(instanceSpheres);
+		for (size_t i = 0; i < instances.size(); i++) addMeshSphere(instanceSpheres, mesh, instances[i]);
+		if (RV::objectCulling) cullSpheres(extractFrustum(RV::_MVP), instanceSpheres, instanceVisible);
+		else instanceVisible.assign(instances.size(), 1);
+		visibleInstances.clear();
+		for (size_t i = 0; i < instances.size(); i++) {
+			if (instanceVisible[i]) visibleInstances.push_back(instances[i]);
+		}
+		RV::objectsVisible += (int)visibleInstances.size();
+		RV::objectsCulled += (int)(instances.size() - visibleInstances.size());
+		if (visibleInstances.empty()) return;
+
+		GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, visibleInstances.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, visibleInstances.size() * sizeof(glm::mat4), visibleInstances.data());
+
+		size_t nearest = 0;
+		float nearestDepth = -FLT_MAX;
+		for (size_t i = 0; i < visibleInstances.size(); i++) {
+			float depth = (RV::_modelView * visibleInstances[i][3]).z;
+			if (depth > nearestDepth) {
+				nearestDepth = depth;
+				nearest = i;
+			}
+		}
+		instancedLod = selectMeshLod(mesh, visibleInstances[nearest]);
+		RV::lodDraws[instancedLod]++;
+		RV::lodTriangles += mesh.lods[instancedLod].indexCount / 3 * (int)visibleInstances.size();
+
+		RenderQueue::DrawItem item;
+		item.program = instancedProgram;
+		item.vao = instanceVao;
+		item.mesh = &mesh;
+		item.color = glm::vec3(cabinaColor);
+		item.uniforms = RenderQueue::SetMesh | RenderQueue::SetColor;
+		item.draw = drawCabinasItem;
+		item.key = RenderQueue::makeKey(RenderQueue::PassOpaque, instancedProgram->id, instanceVao, RenderQueue::colorMaterial(item.color), queueDepth(visibleInstances[nearest][3]));
+		RenderQueue::push(item);
 	}
 
 }
@@ -619,14 +782,10 @@ namespace Cabina {
 ////////////////////////////////////////////////// RADIOS
 namespace Radios {
 
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 
-	GLuint radiosVao;
-	GLuint radiosVbo[3];
-	GLuint radiosShaders[2];
-	GLuint radiosProgram;
+	ShaderProgram * radiosProgram;
 
 	glm::mat4 radiosMat = glm::mat4(1.f);
 	glm::vec4 radiosColor = { 0.1f, 0.1f, 1.f, 0.f };
@@ -634,69 +793,32 @@ namespace Radios {
 	char* radios_vertShader;
 	char* radios_fragShader;
 
-	void setupRadios() {
-		glBufferData(GL_ARRAY_BUFFER, Radios::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &radiosVao);
-		glBindVertexArray(radiosVao);
-		glGenBuffers(2, radiosVbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, radiosVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, radiosVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
-
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		radiosShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-		radiosShaders[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "cubeFrag");
-		
+	// Copies the mesh into the geometry arena once it has finished loading
+	void uploadRadios() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+	}
 
-		radiosProgram = glCreateProgram();
-		glAttachShader(radiosProgram, radiosShaders[0]);
-		glAttachShader(radiosProgram, radiosShaders[1]);
-		glBindAttribLocation(radiosProgram, 0, "in_Position");
-		glBindAttribLocation(radiosProgram, 1, "in_Normal");
-		linkProgram(radiosProgram);
+	void setupRadios() {
+		radiosProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
 		radiosMat = glm::translate(radiosMat, glm::vec3(.0f, 6.3f, .0f));
 	}
 
 	void cleanupRadios() {
-		glDeleteBuffers(2, radiosVbo);
-		glDeleteVertexArrays(1, &radiosVao);
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			mesh.geometry = 0;
+		}
 
-		glDeleteProgram(radiosProgram);
-		glDeleteShader(radiosShaders[0]);
-		glDeleteShader(radiosShaders[1]);
+		releaseProgram(radiosProgram);
+		radiosProgram = NULL;
 	}
 
 	void drawRadios(float currentTime) {
 
-		glBindVertexArray(radiosVao);
-		glUseProgram(radiosProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(radiosProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(radiosMat));
-		glUniformMatrix4fv(glGetUniformLocation(radiosProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(radiosProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(radiosProgram, "light_Position"), ImGui::lightPosition[0] + Luz::rotationX / 100, ImGui::lightPosition[1], ImGui::lightPosition[2]);
-		glUniform3f(glGetUniformLocation(radiosProgram, "color"), radiosColor[0], radiosColor[1], radiosColor[2]);
-		glUniform3f(glGetUniformLocation(radiosProgram, "light_Color"), ImGui::lightColor[0], ImGui::lightColor[1], ImGui::lightColor[2]);
-		glUniformMatrix4fv(glGetUniformLocation(radiosProgram, "camera_Point"), 1, GL_FALSE, glm::value_ptr(RenderVars::_cameraPoint));
-		glUniform1f(glGetUniformLocation(radiosProgram, "kd"), ImGui::Diffuse);
-		glUniform1f(glGetUniformLocation(radiosProgram, "ka"), ImGui::Ambient);
-		glUniform1f(glGetUniformLocation(radiosProgram, "ks"), ImGui::Specular);
-		glUniform1f(glGetUniformLocation(radiosProgram, "light_Power"), ImGui::LightPower);
-		glDrawArrays(GL_TRIANGLES, 0, Radios::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+		if (mesh.geometry == 0) return;
+
+		queueMesh(radiosProgram, mesh, radiosMat, radiosColor, drawMeshClustersItem);
 	}
 
 }
@@ -704,14 +826,10 @@ namespace Radios {
 ////////////////////////////////////////////////// SOPORTE
 namespace Soporte {
 
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec2 > uvs;
-	std::vector< glm::vec3 > normals;
+	Mesh mesh;
+	bool meshReady;
 
-	GLuint soporteVao;
-	GLuint soporteVbo[3];
-	GLuint soporteShaders[2];
-	GLuint soporteProgram;
+	ShaderProgram * soporteProgram;
 
 	glm::mat4 soporteMat = glm::mat4(1.f);
 	glm::vec4 soporteColor = { 0.1f, 0.1f, 1.0f, 0.f };
@@ -719,70 +837,79 @@ namespace Soporte {
 	char* soporte_vertShader;
 	char* soporte_fragShader;
 
-	void setupSoporte() {
-		glBufferData(GL_ARRAY_BUFFER, Soporte::vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-		glGenVertexArrays(1, &soporteVao);
-		glBindVertexArray(soporteVao);
-		glGenBuffers(2, soporteVbo);
+	// Copies the mesh into the geometry arena once it has finished loading
+	void uploadSoporte() {
+		meshReady = true;
+		mesh.geometry = GeometryArena::allocate(mesh);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, soporteVbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(0);
+	void setupSoporte() {
+		soporteProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, soporteVbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-		glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(1);
+	void cleanupSoporte() {
+		if (mesh.geometry != 0) {
+			GeometryArena::release(mesh.geometry);
+			mesh.geometry = 0;
+		}
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		releaseProgram(soporteProgram);
+		soporteProgram = NULL;
+	}
 
-		soporteShaders[0] = compileShader(GL_VERTEX_SHADER, "BasicVert.txt", "cubeVert");
-		soporteShaders[1] = compileShader(GL_FRAGMENT_SHADER, "BasicFrag.txt", "cubeFrag");
+	void drawSoporte(float currentTime) {
 
+		if (mesh.geometry == 0) return;
 
-		soporteProgram = glCreateProgram();
-		glAttachShader(soporteProgram, soporteShaders[0]);
-		glAttachShader(soporteProgram, soporteShaders[1]);
-		glBindAttribLocation(soporteProgram, 0, "in_Position");
-		glBindAttribLocation(soporteProgram, 1, "in_Normal");
-		linkProgram(soporteProgram);
+		queueMesh(soporteProgram, mesh, soporteMat, soporteColor, drawMeshClustersItem);
 	}
 
-	void cleanupSoporte() {
-		glDeleteBuffers(2, soporteVbo);
-		glDeleteVertexArrays(1, &soporteVao);
+}
 
-		glDeleteProgram(soporteProgram);
-		glDeleteShader(soporteShaders[0]);
-		glDeleteShader(soporteShaders[1]);
-	}
+// Camera, lights and material, identical for every draw of a frame. Mirrors the std140
+// FrameData block of the shaders, which is why everything is a mat4, vec4 or float.
+namespace Frame {
+	struct FrameData {
+		glm::mat4 mv_Mat;
+		glm::mat4 mvpMat;
+		glm::vec4 light_Position[2];
+		glm::vec4 light_Color[2];
+		float kd;
+		float ka;
+		float ks;
+		float light_Power;
+	};
 
-	void drawSoporte(float currentTime) {
+	GLuint frameUbo;
 
-		glBindVertexArray(soporteVao);
-		glUseProgram(soporteProgram);
-
-		glUniformMatrix4fv(glGetUniformLocation(soporteProgram, "objMat"), 1, GL_FALSE, glm::value_ptr(soporteMat));
-		glUniformMatrix4fv(glGetUniformLocation(soporteProgram, "mv_Mat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_modelView));
-		glUniformMatrix4fv(glGetUniformLocation(soporteProgram, "mvpMat"), 1, GL_FALSE, glm::value_ptr(RenderVars::_MVP));
-		glUniform3f(glGetUniformLocation(soporteProgram, "light_Position"), ImGui::lightPosition[0] + Luz::rotationX / 100, ImGui::lightPosition[1], ImGui::lightPosition[2]);
-		glUniform3f(glGetUniformLocation(soporteProgram, "color"), soporteColor[0], soporteColor[1], soporteColor[2]);
-		glUniform3f(glGetUniformLocation(soporteProgram, "light_Color"), ImGui::lightColor[0], ImGui::lightColor[1], ImGui::lightColor[2]);
-		glUniformMatrix4fv(glGetUniformLocation(soporteProgram, "camera_Point"), 1, GL_FALSE, glm::value_ptr(RenderVars::_cameraPoint));
-		glUniform1f(glGetUniformLocation(soporteProgram, "kd"), ImGui::Diffuse);
-		glUniform1f(glGetUniformLocation(soporteProgram, "ka"), ImGui::Ambient);
-		glUniform1f(glGetUniformLocation(soporteProgram, "ks"), ImGui::Specular);
-		glUniform1f(glGetUniformLocation(soporteProgram, "light_Power"), ImGui::LightPower);
-		glDrawArrays(GL_TRIANGLES, 0, Soporte::vertices.size());
-
-		glUseProgram(0);
-		glBindVertexArray(0);
+	void setupFrame() {
+		glGenBuffers(1, &frameUbo);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+		GLState::bindBufferBase(GL_UNIFORM_BUFFER, frameDataBinding, frameUbo);
+	}
+	void cleanupFrame() {
+		GLState::deleteBuffers(1, &frameUbo);
+	}
+	// Called once per frame, after the lights have moved and before the first lit draw
+	void updateFrame() {
+		FrameData frame;
+		frame.mv_Mat = RV::_modelView;
+		frame.mvpMat = RV::_MVP;
+		frame.light_Position[0] = glm::vec4(ImGui::lightPosition, 1.f);
+		frame.light_Position[1] = glm::vec4(Luz::position.x + Luz::rotationX / 100, Luz::position.y, Luz::position.z, 1.f);
+		frame.light_Color[0] = glm::vec4(ImGui::lightColor, 1.f);
+		frame.light_Color[1] = glm::vec4(Luz::lightColor[0], Luz::lightColor[1], Luz::lightColor[2], 1.f);
+		frame.kd = ImGui::Diffuse;
+		frame.ka = ImGui::Ambient;
+		frame.ks = ImGui::Specular;
+		frame.light_Power = ImGui::LightPower;
+
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
 	}
-
 }
 
 
@@ -873,12 +1000,18 @@ GLuint myVao; //vertex array
 
 void GLinit(int width, int height) {
 
-	bool res = loadOBJ("box.obj", Luz::vertices, Luz::uvs, Luz::normals);
-	bool res1 = loadOBJ("Gallina.obj", Gallina::vertices, Gallina::uvs, Gallina::normals);
-	bool res2 = loadOBJ("Trump.obj", Trump::vertices, Trump::uvs, Trump::normals);
-	bool res3 = loadOBJ("Cabina.obj", Cabina::vertices, Cabina::uvs, Cabina::normals);
-	bool res4 = loadOBJ("Radios.obj", Radios::vertices, Radios::uvs, Radios::normals);
-	bool res5 = loadOBJ("Soporte.obj", Soporte::vertices, Soporte::uvs, Soporte::normals);
+	RV::initStart = std::chrono::steady_clock::now();
+	GLState::invalidate();
+	Pack::open("assets.pack");
+
+	// Meshes stream in on worker threads; GLrender uploads each one as it arrives
+	Assets::queueMesh("box.obj", &Luz::mesh, Luz::uploadLuz);
+	Assets::queueMesh("Gallina.obj", &Gallina::mesh, Gallina::uploadGallina);
+	Assets::queueMesh("Trump.obj", &Trump::mesh, Trump::uploadTrump);
+	Assets::queueMesh("Cabina.obj", &Cabina::mesh, Cabina::uploadCabina);
+	Assets::queueMesh("Radios.obj", &Radios::mesh, Radios::uploadRadios);
+	Assets::queueMesh("Soporte.obj", &Soporte::mesh, Soporte::uploadSoporte);
+	Assets::startLoading();
 	glViewport(0, 0, width, height);
 
 	glClearColor(0.2f, 0.2f, 0.2f, 1.f);
@@ -887,13 +1020,14 @@ void GLinit(int width, int height) {
 
 	glDepthFunc(GL_LEQUAL);
 
-	glEnable(GL_DEPTH_TEST);
+	GLState::enable(GL_DEPTH_TEST);
 
-	glEnable(GL_CULL_FACE);
+	GLState::enable(GL_CULL_FACE);
 
 
 
 	RV::_projection = glm::perspective(RV::FOV, (float)width / (float)height, RV::zNear, RV::zFar);
+	RV::height = height;
 	RV::_modelView = glm::translate(RV::_modelView, glm::vec3(RV::panv[0], RV::panv[1], RV::panv[2]));
 	RV::_modelView = glm::rotate(RV::_modelView, RV::rota[1], glm::vec3(1.f, 0.f, 0.f));
 	RV::_modelView = glm::rotate(RV::_modelView, RV::rota[0], glm::vec3(0.f, 1.f, 0.f));
@@ -910,6 +1044,12 @@ void GLinit(int width, int height) {
 
 	// Setup shaders & geometry
 
+	Frame::setupFrame();
+	GeometryArena::setup();
+	MultiDraw::setup();
+	flatProgram = acquireProgramAsync("BasicVert.txt", "BasicFrag.txt", meshAttributes, 2);
+	Frame::updateFrame();
+
 	Axis::setupAxis();
 
 	Luz::setupLuz();
@@ -948,6 +1088,8 @@ void GLinit(int width, int height) {
 
 void GLcleanup() {
 
+	Assets::shutdown();
+
 	Axis::cleanupAxis();
 
 	Luz::cleanupLuz();
@@ -962,6 +1104,21 @@ void GLcleanup() {
 
 	Soporte::cleanupSoporte();
 
+	Frame::cleanupFrame();
+
+	releaseProgram(flatProgram);
+	flatProgram = NULL;
+	MultiDraw::cleanup();
+	GeometryArena::cleanup();
+
+	releaseMesh(Luz::mesh);
+	releaseMesh(Gallina::mesh);
+	releaseMesh(Trump::mesh);
+	releaseMesh(Cabina::mesh);
+	releaseMesh(Radios::mesh);
+	releaseMesh(Soporte::mesh);
+	Pack::close();
+
 	/////////////////////////////////////////////////////TODO
 
 	// Do your cleanup code here
@@ -976,6 +1133,34 @@ void GLcleanup() {
 
 }
 
+// Same as pressing the Exercise buttons, for --bench-switch
+void GLrequestExercise(int exercise) {
+	if (exercise == 1) ImGui::exercise1++;
+	else ImGui::exercise2++;
+}
+
+int GLmeshesLoading() {
+	return RV::meshesLoading;
+}
+
+int GLprogramsPending() {
+	return RV::programsPending;
+}
+
+// For --bench-gondolas, path is a RV::DrawPath
+void GLsetGondolas(int count, int path) {
+	RV::gondolaCount = count;
+	RV::drawPath = path;
+}
+
+bool GLmultiDrawSupported() {
+	return MultiDraw::supported();
+}
+
+double GLgondolaSubmitSeconds() {
+	return RV::gondolaSubmitSeconds;
+}
+
 float currentTime = 0;
 
 void GLrender(float dt) {
@@ -984,28 +1169,48 @@ void GLrender(float dt) {
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	if (ImGui::exercise1 & 1)
+	RV::glCalls = GLState::beginFrame();
+	RV::meshesLoading = Assets::uploadLoaded();
+	memset(RV::lodDraws, 0, sizeof(RV::lodDraws));
+	RV::lodTriangles = 0;
+	RV::clustersDrawn = RV::clustersFrustumCulled = RV::clustersConeCulled = 0;
+	RV::clusterTriangles = RV::clusterTrianglesTotal = 0;
+	RV::objectsVisible = RV::objectsCulled = RV::objectsGpuCandidates = 0;
+	if (RV::meshesLoading == 0 && RV::timeToFullScene < 0.0)
 	{
-		Gallina::cleanupGallina();
+		RV::timeToFullScene = std::chrono::duration<double>(std::chrono::steady_clock::now() - RV::initStart).count();
+		printf("Full scene after %.1f ms\n", RV::timeToFullScene * 1e3);
+	}
 
-		Trump::cleanupTrump();
+	// Programs compile in the driver while the first frames draw with the fallback, and
+	// again whenever their source files are edited
+	reloadChangedPrograms();
+	int programsPending = updatePendingPrograms();
+	if (programsPending == 0 && RV::programsPending != 0)
+	{
+		ProgramCacheStats programs = getProgramCacheStats();
+		printf("Shader programs: %d created in %.1f ms, %d from the binary cache (%s start), all ready after %.1f ms\n", programs.linked, programs.seconds * 1e3,
+			programs.binaryHits, programs.binaryHits == programs.linked ? "warm" : "cold",
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - RV::initStart).count() * 1e3);
+	}
+	RV::programsPending = programsPending;
+	RV::gpuCulled = RV::drawPath == RV::PathMultiDraw && RV::gpuCulling && MultiDraw::cullingReady();
 
-		Gallina::setupGallina();
+	// Meshes stay uploaded, only the program handles change
+	if (ImGui::exercise1 & 1)
+	{
+		Gallina::selectGallinaVariant(1);
 
-		Trump::setupTrump();
+		Trump::selectTrumpVariant(1);
 
 		ImGui::exercise1--;
 		ImGui::exercise2 = 0;
 	}
 	else if(ImGui::exercise2 & 1)
 	{
-		Gallina::cleanupGallina();
-
-		Trump::cleanupTrump();
+		Gallina::selectGallinaVariant(2);
 
-		Gallina::setupGallina();
-
-		Trump::setupTrump();
+		Trump::selectTrumpVariant(2);
 
 		ImGui::exercise2--;
 		ImGui::exercise1 = 0;
@@ -1075,6 +1280,9 @@ void GLrender(float dt) {
 		if (Luz::rotationX < -20) Luz::goingRight = true;
 	}
 
+	// Everything queued is drawn after this, so the axis queued above sees this frame's block too
+	Frame::updateFrame();
+
 	Luz::drawLuz(currentTime);
 
 	Gallina::gallinaMat = glm::translate(Gallina::gallinaMat, glm::vec3(0.0f, ((sin(glm::radians(Gallina::angle)) * 5.55) + 5.8) - Gallina::lastY, ((cos(glm::radians(Gallina::angle)) * 5.55) - 0.15) - Gallina::lastX));
@@ -1087,15 +1295,20 @@ void GLrender(float dt) {
 	Trump::lastY = (sin(glm::radians(Trump::angle)) * 5.55) + 5.8;
 	Trump::drawTrump(currentTime);
 
-	for (int i = 0; i < 20; i++)
+	std::chrono::steady_clock::time_point gondolaStart = std::chrono::steady_clock::now();
+	// The slider does not clamp values typed in with Ctrl+click
+	RV::gondolaCount = glm::clamp(RV::gondolaCount, 1, RV::maxGondolas);
+	Cabina::placeCabinas(RV::gondolaCount);
+	if (RV::drawPath == RV::PathInstanced) Cabina::drawCabinasInstanced();
+	else
 	{
-		Cabina::cabinaMat = glm::translate(Cabina::cabinaMat, glm::vec3((cos(glm::radians(Cabina::angle)) * 5.55) - Cabina::lastX, ((sin(glm::radians(Cabina::angle)) * 5.55) + 6.3) - Cabina::lastY, .0f));
-		Cabina::drawCabina(currentTime);
-		Cabina::lastX = (cos(glm::radians(Cabina::angle)) * 5.55);
-		Cabina::lastY = (sin(glm::radians(Cabina::angle)) * 5.55) + 6.3;
-		Cabina::angle += 18;
-		if (Cabina::angle >= 360) Cabina::angle -= 360;
+		for (int i = 0; i < RV::gondolaCount; i++)
+		{
+			Cabina::cabinaMat = Cabina::instances[i];
+			Cabina::drawCabina(currentTime);
+		}
 	}
+	double gondolaQueueSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - gondolaStart).count();
 
 	Radios::radiosMat = glm::rotate(Radios::radiosMat, (float)glm::radians(ImGui::Velocity), glm::vec3(0, 0, 1));
 	Radios::drawRadios(currentTime);
@@ -1107,11 +1320,20 @@ void GLrender(float dt) {
 
 	Soporte::drawSoporte(currentTime);
 
+	// The draw functions above only queue, everything is drawn here in key order. The rest
+	// of the scene goes through the same submit, a cost every gondola path shares.
+	std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+	cullQueuedMeshes();
+	MultiDraw::queue(RV::gpuCulled);
+	RenderQueue::submit();
+	RV::gondolaSubmitSeconds = gondolaQueueSeconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - submitStart).count();
+	RV::queue = RenderQueue::getStats();
+
 	//EX1:
 	//glPointSize(40.0f);
 
-	glBindVertexArray(myVao);
-	glUseProgram(myRenderProgram);
+	GLState::bindVertexArray(myVao);
+	GLState::useProgram(myRenderProgram);
 
 	//EX1:
 	//glDrawArrays(GL_POINTS, 0, 1);
@@ -1139,6 +1361,11 @@ void GLrender(float dt) {
 
 	ImGui::Render();
 
+	if (RV::timeToFirstFrame < 0.0)
+	{
+		RV::timeToFirstFrame = std::chrono::duration<double>(std::chrono::steady_clock::now() - RV::initStart).count();
+		printf("First frame after %.1f ms\n", RV::timeToFirstFrame * 1e3);
+	}
 }
 
 void GUI() {
@@ -1147,6 +1374,41 @@ void GUI() {
 
 	{
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+		if (RV::timeToFirstFrame < 0.0) ImGui::Text("First frame pending, loading %d meshes...", RV::meshesLoading);
+		else if (RV::timeToFullScene < 0.0) ImGui::Text("First frame %.1f ms, loading %d meshes...", RV::timeToFirstFrame * 1e3, RV::meshesLoading);
+		else ImGui::Text("First frame %.1f ms, full scene %.1f ms", RV::timeToFirstFrame * 1e3, RV::timeToFullScene * 1e3);
+		ProgramCacheStats programs = getProgramCacheStats();
+		ImGui::Text("Shader programs %d live, %d linked for %d requests, %d compiling", programs.live, programs.linked, programs.acquired, programs.pending);
+		ImGui::Text("Program creation %.1f ms, %d from binary cache, %d reloads", programs.seconds * 1e3, programs.binaryHits, programs.reloads);
+		ImGui::Text("LOD draws %d / %d / %d / %d, %d triangles", RV::lodDraws[0], RV::lodDraws[1], RV::lodDraws[2], RV::lodDraws[3], RV::lodTriangles);
+		ImGui::DragFloat("LOD pixel error", &RV::lodPixelError, 0.05f, 0.0f, 16.0f);
+		ImGui::Checkbox("Object culling", &RV::objectCulling);
+		ImGui::Checkbox("Cluster culling", &RV::clusterCulling);
+		ImGui::Checkbox("Report undeclared uniforms", &uniformDebug);
+		ImGui::Text("Objects visible %d, frustum culled %d (%s), GPU candidates %d", RV::objectsVisible, RV::objectsCulled, cullSpheresKernel(), RV::objectsGpuCandidates);
+		ImGui::Text("Clusters drawn %d, frustum culled %d, cone culled %d", RV::clustersDrawn, RV::clustersFrustumCulled, RV::clustersConeCulled);
+		ImGui::Text("Cluster triangles %d of %d", RV::clusterTriangles, RV::clusterTrianglesTotal);
+		ImGui::Text("GL state calls %d issued, %d elided", RV::glCalls.issued, RV::glCalls.elided);
+		GeometryArena::Stats arena = GeometryArena::getStats();
+		ImGui::Text("Geometry arena %d meshes, %.1f / %.1f MB vertices, %.1f / %.1f MB indices", arena.allocations,
+			arena.verticesUsed * sizeof(PackedVertex) / 1048576.0, arena.vertexCapacity * sizeof(PackedVertex) / 1048576.0, arena.indicesUsed / 1048576.0, arena.indexCapacity / 1048576.0);
+		ImGui::Text("Arena holes %d, %d relocations", arena.freeRanges, arena.relocations);
+		ImGui::Text("Render queue %d draws sorted in %.3f ms, %d uniforms elided", RV::queue.draws, RV::queue.sortSeconds * 1e3, RV::queue.uniformsElided);
+		ImGui::Text("Program switches %d (%d saved), VAO switches %d (%d saved)", RV::queue.programSwitches, RV::queue.programSwitchesSaved, RV::queue.vaoSwitches, RV::queue.vaoSwitchesSaved);
+		ImGui::DragInt("Gondolas", &RV::gondolaCount, 10.f, 1, RV::maxGondolas);
+		ImGui::RadioButton("Per draw", &RV::drawPath, RV::PathPerDraw);
+		ImGui::SameLine();
+		ImGui::RadioButton("Instanced", &RV::drawPath, RV::PathInstanced);
+		ImGui::SameLine();
+		if (MultiDraw::supported()) ImGui::RadioButton("Multi-draw indirect", &RV::drawPath, RV::PathMultiDraw);
+		else ImGui::Text("(multi-draw indirect needs GL 4.3)");
+		MultiDraw::Stats multiDraw = MultiDraw::getStats();
+		if (RV::drawPath == RV::PathMultiDraw) {
+			ImGui::Checkbox("GPU culling", &RV::gpuCulling);
+			if (multiDraw.gpuCulled) ImGui::Text("Multi-draw %d candidates culled on the GPU, %s", multiDraw.commands, multiDraw.countDraw ? "compacted and counted" : "fixed count");
+			else ImGui::Text("Multi-draw %d commands in %d calls, draw ID from %s", multiDraw.commands, multiDraw.calls, multiDraw.drawParameters ? "gl_DrawIDARB" : "baseInstance");
+		}
+		ImGui::Text("Gondola submit %.3f ms", RV::gondolaSubmitSeconds * 1e3);
 
 		/////////////////////////////////////////////////////TODO
 		// Do your GUI code here....
@@ -0,0 +1,143 @@
+#include <chrono>
+#include <vector>
+
+#include "glstate.h"
+#include "renderqueue.h"
+
+namespace {
+	const GLuint unknown = 0xFFFFFFFF;
+
+	std::vector< RenderQueue::DrawItem > items;
+	RenderQueue::Stats stats;
+
+	// Keys and item indices, sorted together
+	struct SortEntry {
+		uint64_t key;
+		unsigned int item;
+	};
+	std::vector< SortEntry > entries, scratch;
+
+	uint64_t field(uint64_t value, int bits) {
+		return value & ((uint64_t(1) << bits) - 1);
+	}
+
+	// Least significant digit radix sort, a byte per pass. Passes whose byte is the same for
+	// every key are skipped, which with few programs and VAOs is most of the upper ones.
+	void radixSort() {
+		size_t count = entries.size();
+		scratch.resize(count);
+		for (int shift = 0; shift < 64; shift += 8) {
+			size_t histogram[256] = {};
+			for (size_t i = 0; i < count; i++) histogram[(entries[i].key >> shift) & 0xFF]++;
+			if (histogram[(entries[0].key >> shift) & 0xFF] == count) continue;
+
+			size_t offset = 0;
+			for (int digit = 0; digit < 256; digit++) {
+				size_t bucket = histogram[digit];
+				histogram[digit] = offset;
+				offset += bucket;
+			}
+			for (size_t i = 0; i < count; i++) scratch[histogram[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+			entries.swap(scratch);
+		}
+	}
+}
+
+namespace RenderQueue {
+	uint64_t makeKey(Pass pass, GLuint program, GLuint vao, unsigned int material, float depth) {
+		depth = depth < 0.f ? 0.f : depth > 1.f ? 1.f : depth;
+		uint64_t depthBits = (uint64_t)(depth * float((1 << 24) - 1));
+		return field(pass, 4) << 60 | field(program, 12) << 48 | field(vao, 12) << 36 | field(material, 12) << 24 | depthBits;
+	}
+
+	unsigned int colorMaterial(const glm::vec3 & color) {
+		glm::vec3 clamped = glm::clamp(color, 0.f, 1.f) * 15.f + 0.5f;
+		return (unsigned int)clamped.r << 8 | (unsigned int)clamped.g << 4 | (unsigned int)clamped.b;
+	}
+
+	void push(const DrawItem & item) {
+		items.push_back(item);
+	}
+
+	void submit() {
+		stats = Stats();
+		stats.draws = (int)items.size();
+		if (items.empty()) return;
+
+		// What drawing in push order would have cost, for the savings shown in the GUI
+		GLuint program = unknown, vao = unknown;
+		for (size_t i = 0; i < items.size(); i++) {
+			if (items[i].program->id != program) stats.programSwitchesSaved++;
+			if (items[i].vao != vao) stats.vaoSwitchesSaved++;
+			program = items[i].program->id;
+			vao = items[i].vao;
+		}
+
+		std::chrono::steady_clock::time_point sortStart = std::chrono::steady_clock::now();
+		entries.resize(items.size());
+		for (size_t i = 0; i < items.size(); i++) {
+			entries[i].key = items[i].key;
+			entries[i].item = (unsigned int)i;
+		}
+		radixSort();
+		stats.sortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sortStart).count();
+
+		// Uniform values live in the program, so what was set is forgotten on every switch
+		program = unknown;
+		vao = unknown;
+		const Mesh * mesh = NULL;
+		glm::mat4 objMat;
+		glm::vec3 color;
+		bool objMatSet = false, colorSet = false;
+		for (size_t i = 0; i < entries.size(); i++) {
+			const DrawItem & item = items[entries[i].item];
+			if (item.program->id != program) {
+				program = item.program->id;
+				GLState::useProgram(program);
+				stats.programSwitches++;
+				mesh = NULL;
+				objMatSet = colorSet = false;
+			}
+			if (item.vao != vao) {
+				vao = item.vao;
+				GLState::bindVertexArray(vao);
+				stats.vaoSwitches++;
+			}
+
+			if (item.uniforms & SetObjMat) {
+				if (objMatSet && item.objMat == objMat) stats.uniformsElided++;
+				else {
+					setUniform(item.program, U_objMat, item.objMat);
+					objMat = item.objMat;
+					objMatSet = true;
+				}
+			}
+			if (item.uniforms & SetMesh) {
+				if (item.mesh == mesh) stats.uniformsElided += 2;
+				else {
+					setUniform(item.program, U_pos_Offset, item.mesh->boundsMin);
+					setUniform(item.program, U_pos_Scale, item.mesh->boundsMax - item.mesh->boundsMin);
+					mesh = item.mesh;
+				}
+			}
+			if (item.uniforms & SetColor) {
+				if (colorSet && item.color == color) stats.uniformsElided++;
+				else {
+					setUniform(item.program, U_color, item.color);
+					color = item.color;
+					colorSet = true;
+				}
+			}
+
+			item.draw(item);
+		}
+
+		stats.programSwitchesSaved -= stats.programSwitches;
+		stats.vaoSwitchesSaved -= stats.vaoSwitches;
+		items.clear();
+	}
+
+	Stats getStats() {
+		return stats;
+	}
+}
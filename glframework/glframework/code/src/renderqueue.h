@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <GL\glew.h>
+#include <glm\gtc\type_ptr.hpp>
+
+#include "meshcache.h"
+#include "shader.h"
+
+// Draws of a frame are pushed in any order with a 64-bit sort key and submitted together
+// once sorted, so that draws sharing a program and VAO end up next to each other. From the
+// most significant bits down the key holds:
+//   pass (4) | program (12) | VAO (12) | material (12) | depth (24)
+// Program and VAO are the low bits of their GL names, which stay small in practice; a
+// collision only costs an extra switch, every item still binds its own.
+namespace RenderQueue {
+	enum Pass {
+		PassOpaque,	// front to back, later passes are drawn after it
+	};
+
+	struct DrawItem;
+	typedef void (*DrawFunction)(const DrawItem & item);
+
+	// Uniforms the queue sets before calling draw, only when they differ from what the
+	// previous item left in the same program
+	enum {
+		SetObjMat = 1,	// objMat
+		SetMesh = 2,	// pos_Offset and pos_Scale of mesh
+		SetColor = 4,	// color
+	};
+
+	struct DrawItem {
+		uint64_t key;
+		ShaderProgram * program;
+		GLuint vao;
+		const Mesh * mesh;
+		glm::mat4 objMat;
+		glm::vec3 color;
+		unsigned int uniforms;	// Set* flags
+		DrawFunction draw;	// issues the draw call with program and VAO already bound
+	};
+
+	// depth is the view distance over the far plane, clamped to [0, 1]
+	uint64_t makeKey(Pass pass, GLuint program, GLuint vao, unsigned int material, float depth);
+	// Material bits of a flat colour, 4 bits per channel, so equal colours sort together
+	unsigned int colorMaterial(const glm::vec3 & color);
+
+	void push(const DrawItem & item);
+	// Sorts everything pushed since the last submit, draws it and empties the queue
+	void submit();
+
+	struct Stats {
+		int draws;
+		int programSwitches, vaoSwitches;	// as submitted
+		int programSwitchesSaved, vaoSwitchesSaved;	// against drawing in push order
+		int uniformsElided;
+		double sortSeconds;
+	};
+	// Counters of the last submit
+	Stats getStats();
+}
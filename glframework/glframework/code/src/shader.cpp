@@ -0,0 +1,607 @@
+#include "shader.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include "filemap.h"
+#include "filewatch.h"
+#include "hash.h"
+#include "pack.h"
+
+const char * const uniformNames[UniformCount] = {
+	"objMat",
+	"pos_Offset",
+	"pos_Scale",
+	"color",
+	"draw_Offset",
+	"draw_Count",
+	"draw_Split",
+};
+
+#ifdef _DEBUG
+bool uniformDebug = true;
+#else
+bool uniformDebug = false;
+#endif
+
+namespace {
+	std::vector< ShaderProgram * > programs;
+	ProgramCacheStats stats;
+
+	const char programBinaryMagic[4] = { 'G', 'L', 'P', 'B' };
+	const unsigned int programBinaryVersion = 1;
+
+	struct ProgramBinaryHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned long long key;
+		unsigned int format;
+		unsigned int size;
+	};
+
+	// Binary formats the driver accepts, filled by driverKey
+	std::vector< GLint > binaryFormats;
+
+	// Hash of the driver identification, so binaries never cross drivers or GPUs. 0 when
+	// program binaries are unavailable.
+	unsigned long long driverKey() {
+		static bool done = false;
+		static unsigned long long key = 0;
+		if (done) return key;
+		done = true;
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		if (formats <= 0) return key;
+		binaryFormats.resize(formats);
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, binaryFormats.data());
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		key = 1;
+		for (int i = 0; i < 3; i++) {
+			const char * value = (const char *)glGetString(names[i]);
+			if (value) key = hashBytes(value, strlen(value) + 1, key);
+		}
+		return key;
+	}
+
+	std::string programBinaryPath(unsigned long long key) {
+		char name[32];
+		sprintf(name, "/%016llx.bin", key);
+		return std::string(programCacheDir) + name;
+	}
+
+	// Creates the program from a cached binary. Failure of any kind (missing, stale or
+	// rejected by the driver) returns 0 and the caller compiles from source. Only formats
+	// the driver lists are handed to it, so a rejection is a failed link, never a GL error.
+	GLuint loadProgramBinary(unsigned long long key) {
+		MappedFile file;
+		if (!mapFile(programBinaryPath(key).c_str(), file)) {
+			return 0;
+		}
+		const ProgramBinaryHeader * header = (const ProgramBinaryHeader *)file.data;
+		GLuint id = 0;
+		if (file.size >= sizeof(ProgramBinaryHeader) && memcmp(header->magic, programBinaryMagic, 4) == 0 &&
+			header->version == programBinaryVersion && header->key == key && sizeof(ProgramBinaryHeader) + header->size <= file.size &&
+			std::find(binaryFormats.begin(), binaryFormats.end(), (GLint)header->format) != binaryFormats.end()) {
+			id = glCreateProgram();
+			glProgramBinary(id, header->format, file.data + sizeof(ProgramBinaryHeader), header->size);
+			GLint linked = GL_FALSE;
+			glGetProgramiv(id, GL_LINK_STATUS, &linked);
+			if (linked == GL_FALSE) {
+				glDeleteProgram(id);
+				id = 0;
+			}
+		}
+		unmapFile(file);
+		return id;
+	}
+
+	// Fills the uniform table from the program's active uniforms
+	void reflectUniforms(ShaderProgram * program) {
+		for (int u = 0; u < UniformCount; u++) {
+			program->uniforms[u].location = -1;
+			program->uniforms[u].type = GL_NONE;
+		}
+		program->reported = 0;
+
+		GLint count = 0;
+		glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &count);
+		for (GLint i = 0; i < count; i++) {
+			char name[64];
+			GLsizei length;
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(program->id, i, sizeof(name), &length, &size, &type, name);
+			// Block members are fed through their uniform buffer
+			GLuint index = i;
+			GLint block;
+			glGetActiveUniformsiv(program->id, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+			if (block >= 0) continue;
+			int u = 0;
+			while (u < UniformCount && strcmp(uniformNames[u], name) != 0) u++;
+			if (u == UniformCount) {
+				if (uniformDebug) fprintf(stderr, "Uniform %s of %s has no UniformId, it is never set\n", name, program->name.c_str());
+				continue;
+			}
+			program->uniforms[u].location = glGetUniformLocation(program->id, name);
+			program->uniforms[u].type = type;
+		}
+
+		// Block bindings are not part of a program binary, so this runs on both paths
+		GLuint frameData = glGetUniformBlockIndex(program->id, "FrameData");
+		if (frameData != GL_INVALID_INDEX) glUniformBlockBinding(program->id, frameData, frameDataBinding);
+	}
+
+	void saveProgramBinary(GLuint id, unsigned long long key) {
+		GLint length = 0;
+		glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+		std::vector< char > blob(sizeof(ProgramBinaryHeader) + length);
+		ProgramBinaryHeader * header = (ProgramBinaryHeader *)&blob[0];
+		GLenum format = 0;
+		glGetProgramBinary(id, length, &length, &format, &blob[sizeof(ProgramBinaryHeader)]);
+		memcpy(header->magic, programBinaryMagic, 4);
+		header->version = programBinaryVersion;
+		header->key = key;
+		header->format = format;
+		header->size = (unsigned int)length;
+		makeDirectory(programCacheDir);
+		writeFileAtomic(programBinaryPath(key).c_str(), blob.data(), sizeof(ProgramBinaryHeader) + length);
+	}
+
+	void readLooseSource(const std::string & path, std::string & storage, const GLchar *& text, GLint & length) {
+		std::stringstream stream;
+		std::ifstream myFile(path);
+		if (myFile.is_open())
+		{
+			stream << myFile.rdbuf();
+			myFile.close();
+			storage = stream.str();
+		}
+		text = storage.c_str();
+		length = (GLint)storage.size();
+	}
+
+	// Sources come straight out of the asset pack when it has them up to date. storage
+	// keeps a loose file alive for as long as text is used.
+	void readShaderSource(const std::string & path, std::string & storage, const GLchar *& text, GLint & length) {
+		size_t packedSize;
+		if (Pack::find(path.c_str(), text, packedSize)) {
+			length = (GLint)packedSize;
+			return;
+		}
+		readLooseSource(path, storage, text, length);
+	}
+
+	// Location i is implied by the order, the NUL keeps "a","bc" and "ab","c" apart
+	unsigned long long programKey(const GLchar * vertexText, GLint vertexLength, const GLchar * fragmentText, GLint fragmentLength,
+		const char * const * attributes, int attributeCount) {
+		unsigned long long key = hashBytes(vertexText, vertexLength);
+		key = hashBytes(fragmentText, fragmentLength, key);
+		for (int i = 0; i < attributeCount; i++) key = hashBytes(attributes[i], strlen(attributes[i]) + 1, key);
+		return key;
+	}
+
+	const int maxIncludeDepth = 8;
+
+	// Expands #include "file" (resolved next to the including file) and adds a #define per
+	// entry of defines, "NAME" or "NAME=value" separated by spaces, right after #version.
+	// Every file read is appended to files, and #line directives keep compiler messages
+	// pointing at the right line, the source number being the file's index in files.
+	bool preprocess(const std::string & path, bool loose, const std::string & defines, std::string & out, std::vector< std::string > & files, int depth) {
+		std::string storage;
+		const GLchar * text;
+		GLint length;
+		if (loose) readLooseSource(path, storage, text, length);
+		else readShaderSource(path, storage, text, length);
+		if (length == 0) {
+			fprintf(stderr, "Shader source %s is missing or empty\n", path.c_str());
+			return false;
+		}
+		int source = (int)files.size();
+		files.push_back(path);
+		size_t slash = path.find_last_of("/\\");
+		std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+		char directive[32];
+		if (depth > 0) {
+			sprintf(directive, "#line 1 %d\n", source);
+			out += directive;
+		}
+
+		const char * end = text + length;
+		const char * p = text;
+		for (int line = 1; p < end; line++) {
+			const char * eol = (const char *)memchr(p, '\n', end - p);
+			if (eol == NULL) eol = end;
+			std::string current(p, eol);
+			p = eol + 1;
+			size_t first = current.find_first_not_of(" \t");
+			if (first != std::string::npos && current.compare(first, 8, "#include") == 0) {
+				size_t open = current.find('"', first + 8);
+				size_t close = open == std::string::npos ? open : current.find('"', open + 1);
+				if (close == std::string::npos || depth >= maxIncludeDepth) {
+					fprintf(stderr, "Bad #include at %s(%d)\n", path.c_str(), line);
+					return false;
+				}
+				if (!preprocess(directory + current.substr(open + 1, close - open - 1), loose, std::string(), out, files, depth + 1)) return false;
+				sprintf(directive, "#line %d %d\n", line + 1, source);
+				out += directive;
+				continue;
+			}
+			out += current;
+			out += '\n';
+			if (depth == 0 && first != std::string::npos && current.compare(first, 8, "#version") == 0) {
+				std::istringstream tokens(defines);
+				std::string define;
+				while (tokens >> define) {
+					size_t equals = define.find('=');
+					if (equals == std::string::npos) out += "#define " + define + "\n";
+					else out += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+				}
+				sprintf(directive, "#line %d %d\n", line + 1, source);
+				out += directive;
+			}
+		}
+		return true;
+	}
+
+	void printShaderLog(GLuint shader, const char * name) {
+		GLint res;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &res);
+		if (res == GL_TRUE) return;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &res);
+		char *buff = new char[res];
+		glGetShaderInfoLog(shader, res, &res, buff);
+		fprintf(stderr, "Error Shader %s: %s", name, buff);
+		delete[] buff;
+	}
+
+	GLuint compileSource(GLenum shaderType, const GLchar * text, GLint length, const char * name) {
+		GLuint shader = glCreateShader(shaderType);
+		glShaderSource(shader, 1, &text, &length);
+		glCompileShader(shader);
+		GLint res;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &res);
+		if (res == GL_FALSE) {
+			printShaderLog(shader, name);
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+
+	void printProgramLog(GLuint program) {
+		GLint res;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &res);
+		char *buff = new char[res];
+		glGetProgramInfoLog(program, res, &res, buff);
+		fprintf(stderr, "Error Link: %s", buff);
+		delete[] buff;
+	}
+}
+
+GLuint compileShader(GLenum shaderType, std::string shaderName, const char* name) {
+	std::string text;
+	std::vector< std::string > files;
+	if (!preprocess(shaderName, false, std::string(), text, files, 0)) return 0;
+	return compileSource(shaderType, text.c_str(), (GLint)text.size(), name);
+}
+
+void linkProgram(GLuint program) {
+	glLinkProgram(program);
+	GLint res;
+	glGetProgramiv(program, GL_LINK_STATUS, &res);
+	if (res == GL_FALSE) {
+		printProgramLog(program);
+	}
+}
+
+namespace {
+	// Flat colour stand-in drawn with while a program is still compiling, or for good if
+	// it failed. It reads the same uniforms as the scene programs.
+	const GLchar * fallbackVertexSource =
+		"#version 330\n"
+		"layout(location = 0) in vec3 in_Position;\n"
+		"uniform mat4 objMat;\n"
+		"layout(std140) uniform FrameData {\n"
+		"	mat4 mv_Mat;\n"
+		"	mat4 mvpMat;\n"
+		"};\n"
+		"uniform vec3 pos_Offset;\n"
+		"uniform vec3 pos_Scale;\n"
+		"void main() {\n"
+		"	gl_Position = mvpMat * objMat * vec4(pos_Offset + in_Position * pos_Scale, 1.0);\n"
+		"}\n";
+	const GLchar * fallbackFragmentSource =
+		"#version 330\n"
+		"uniform vec3 color;\n"
+		"out vec4 out_Color;\n"
+		"void main() {\n"
+		"	out_Color = vec4(color, 1.0);\n"
+		"}\n";
+
+	GLuint fallback = 0;
+	bool parallelCompile = false;
+
+	GLuint fallbackProgram() {
+		if (fallback != 0) return fallback;
+		GLuint vertex = compileSource(GL_VERTEX_SHADER, fallbackVertexSource, (GLint)strlen(fallbackVertexSource), "fallback");
+		GLuint fragment = compileSource(GL_FRAGMENT_SHADER, fallbackFragmentSource, (GLint)strlen(fallbackFragmentSource), "fallback");
+		fallback = glCreateProgram();
+		glAttachShader(fallback, vertex);
+		glAttachShader(fallback, fragment);
+		linkProgram(fallback);
+		glDetachShader(fallback, vertex);
+		glDetachShader(fallback, fragment);
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return fallback;
+	}
+
+	// The driver compiles on as many threads as it likes from the first acquire on. Done
+	// there rather than with the fallback, which a warm start from binaries never builds
+	// while later reloads still compile.
+	void setupParallelCompile() {
+		static bool done = false;
+		if (done) return;
+		done = true;
+		parallelCompile = GLEW_ARB_parallel_shader_compile != 0;
+		if (parallelCompile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+
+	// Compute programs have their only source in vertexPath and no fragment stage
+	bool isCompute(const ShaderProgram * program) {
+		return program->fragmentPath.empty();
+	}
+	int stageCount(const ShaderProgram * program) {
+		return isCompute(program) ? 1 : 2;
+	}
+
+	// Compiles and links without asking for any status, so the driver is free to do the
+	// work in the background
+	void submitProgram(ShaderProgram * program, const GLchar * vertexText, GLint vertexLength, const GLchar * fragmentText, GLint fragmentLength,
+		const char * const * attributes, int attributeCount) {
+		GLuint shaders[2] = { glCreateShader(isCompute(program) ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER), 0 };
+		if (!isCompute(program)) shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+		const GLchar * texts[2] = { vertexText, fragmentText };
+		GLint lengths[2] = { vertexLength, fragmentLength };
+		GLuint id = glCreateProgram();
+		for (int i = 0; i < stageCount(program); i++) {
+			glShaderSource(shaders[i], 1, &texts[i], &lengths[i]);
+			glCompileShader(shaders[i]);
+			glAttachShader(id, shaders[i]);
+		}
+		for (int i = 0; i < attributeCount; i++) glBindAttribLocation(id, i, attributes[i]);
+		if (program->binaryKey != 0) glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(id);
+		program->pending = id;
+		program->pendingShaders[0] = shaders[0];
+		program->pendingShaders[1] = shaders[1];
+	}
+
+	void cancelPending(ShaderProgram * program) {
+		if (program->pending == 0) return;
+		for (int i = 0; i < stageCount(program); i++) {
+			glDetachShader(program->pending, program->pendingShaders[i]);
+			glDeleteShader(program->pendingShaders[i]);
+		}
+		glDeleteProgram(program->pending);
+		program->pending = 0;
+	}
+
+	// Waits for the submitted program if it is not done yet, then swaps it in or, when it
+	// failed, reports why and keeps the current one (the fallback on a first compile)
+	void finishProgram(ShaderProgram * program) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program->pending, GL_LINK_STATUS, &linked);
+		if (linked == GL_FALSE) {
+			printShaderLog(program->pendingShaders[0], program->vertexPath.c_str());
+			if (!isCompute(program)) printShaderLog(program->pendingShaders[1], program->fragmentPath.c_str());
+			printProgramLog(program->pending);
+			// Messages are "source:line", the source being an index in here
+			for (size_t i = 0; i < program->files.size(); i++) fprintf(stderr, "  source %d: %s\n", (int)i, program->files[i].c_str());
+		}
+		// The linked program keeps its own copy of the code
+		for (int i = 0; i < stageCount(program); i++) {
+			glDetachShader(program->pending, program->pendingShaders[i]);
+			glDeleteShader(program->pendingShaders[i]);
+		}
+		// A failed reload keeps drawing with the program it was meant to replace
+		if (linked == GL_TRUE) {
+			if (program->id != fallback) glDeleteProgram(program->id);
+			program->id = program->pending;
+			program->linked = true;
+			if (program->binaryKey != 0) saveProgramBinary(program->id, program->binaryKey);
+		}
+		else {
+			glDeleteProgram(program->pending);
+			if (program->id != fallback) fprintf(stderr, "Keeping the previous %s\n", program->name.c_str());
+		}
+		program->pending = 0;
+		reflectUniforms(program);
+		stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	ShaderProgram * acquire(const char * vertexPath, const char * fragmentPath, const char * const * attributes, int attributeCount, const char * defines, bool wait) {
+		stats.acquired++;
+		setupParallelCompile();
+		std::string vertexText, fragmentText;
+		std::vector< std::string > files;
+		if (defines == NULL) defines = "";
+		preprocess(vertexPath, false, defines, vertexText, files, 0);
+		if (fragmentPath[0] != '\0') preprocess(fragmentPath, false, defines, fragmentText, files, 0);
+
+		// Each permutation expands to different text, so it gets its own key and binary
+		unsigned long long key = programKey(vertexText.c_str(), (GLint)vertexText.size(), fragmentText.c_str(), (GLint)fragmentText.size(), attributes, attributeCount);
+
+		for (size_t i = 0; i < programs.size(); i++) {
+			if (programs[i]->key == key) {
+				programs[i]->refs++;
+				if (wait && programs[i]->pending != 0) finishProgram(programs[i]);
+				return programs[i];
+			}
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ShaderProgram * program = new ShaderProgram;
+		program->key = key;
+		program->refs = 1;
+		program->name = vertexPath;
+		if (fragmentPath[0] != '\0') program->name += std::string(" + ") + fragmentPath;
+		if (defines[0] != '\0') program->name += std::string(" [") + defines + "]";
+		program->vertexPath = vertexPath;
+		program->fragmentPath = fragmentPath;
+		program->defines = defines;
+		program->attributes.assign(attributes, attributes + attributeCount);
+		program->files = files;
+		program->pending = 0;
+		program->linked = false;
+		for (size_t i = 0; i < files.size(); i++) watchFile(files[i].c_str());
+		unsigned long long driver = driverKey();
+		program->binaryKey = driver != 0 ? hashBytes(&key, sizeof(key), driver) : 0;
+		program->id = program->binaryKey != 0 ? loadProgramBinary(program->binaryKey) : 0;
+		if (program->id != 0) {
+			program->linked = true;
+			stats.binaryHits++;
+		}
+		else {
+			program->id = fallbackProgram();
+			submitProgram(program, vertexText.c_str(), (GLint)vertexText.size(), fragmentText.c_str(), (GLint)fragmentText.size(), attributes, attributeCount);
+		}
+		stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		reflectUniforms(program);
+		programs.push_back(program);
+		stats.linked++;
+		if (wait && program->pending != 0) finishProgram(program);
+		return program;
+	}
+}
+
+ShaderProgram * acquireProgram(const char * vertexPath, const char * fragmentPath, const char * const * attributes, int attributeCount, const char * defines)
+{
+	return acquire(vertexPath, fragmentPath, attributes, attributeCount, defines, true);
+}
+
+ShaderProgram * acquireProgramAsync(const char * vertexPath, const char * fragmentPath, const char * const * attributes, int attributeCount, const char * defines)
+{
+	return acquire(vertexPath, fragmentPath, attributes, attributeCount, defines, false);
+}
+
+ShaderProgram * acquireComputeProgramAsync(const char * computePath, const char * defines)
+{
+	return acquire(computePath, "", NULL, 0, defines, false);
+}
+
+int updatePendingPrograms()
+{
+	int pending = 0;
+	bool finished = false;
+	for (size_t i = 0; i < programs.size(); i++) {
+		ShaderProgram * program = programs[i];
+		if (program->pending == 0) {
+			continue;
+		}
+		// Without the extension there is no way to ask without waiting, so at most one
+		// program per call finishes and the stall is spread over frames
+		GLint done = GL_FALSE;
+		if (parallelCompile) glGetProgramiv(program->pending, GL_COMPLETION_STATUS_ARB, &done);
+		else done = finished ? GL_FALSE : GL_TRUE;
+		if (done == GL_TRUE) {
+			finishProgram(program);
+			finished = true;
+		}
+		else pending++;
+	}
+	return pending;
+}
+
+void reloadChangedPrograms()
+{
+	std::vector< std::string > changed;
+	pollChangedFiles(changed);
+	if (changed.empty()) {
+		return;
+	}
+	for (size_t i = 0; i < programs.size(); i++) {
+		ShaderProgram * program = programs[i];
+		bool dirty = false;
+		for (size_t c = 0; c < changed.size(); c++) {
+			for (size_t f = 0; f < program->files.size(); f++) {
+				if (changed[c] == program->files[f]) dirty = true;
+			}
+		}
+		if (!dirty) continue;
+
+		// Edits happen on the loose files, even when the program first came from the pack
+		std::string vertexText, fragmentText;
+		std::vector< std::string > files;
+		if (!preprocess(program->vertexPath, true, program->defines, vertexText, files, 0) ||
+			(!isCompute(program) && !preprocess(program->fragmentPath, true, program->defines, fragmentText, files, 0))) continue;
+		// An edit may have added or removed includes
+		program->files = files;
+		for (size_t f = 0; f < files.size(); f++) watchFile(files[f].c_str());
+
+		std::vector< const char * > attributes;
+		for (size_t a = 0; a < program->attributes.size(); a++) attributes.push_back(program->attributes[a].c_str());
+		int attributeCount = (int)attributes.size();
+		// key stays the one acquire looks programs up by, only the binary follows the new text
+		unsigned long long sourceKey = programKey(vertexText.c_str(), (GLint)vertexText.size(), fragmentText.c_str(), (GLint)fragmentText.size(), attributes.data(), attributeCount);
+		unsigned long long driver = driverKey();
+		program->binaryKey = driver != 0 ? hashBytes(&sourceKey, sizeof(sourceKey), driver) : 0;
+
+		cancelPending(program);
+		submitProgram(program, vertexText.c_str(), (GLint)vertexText.size(), fragmentText.c_str(), (GLint)fragmentText.size(), attributes.data(), attributeCount);
+		stats.reloads++;
+		printf("Reloading %s\n", program->name.c_str());
+	}
+}
+
+void releaseProgram(ShaderProgram * program)
+{
+	if (program == NULL || --program->refs > 0) {
+		return;
+	}
+	for (size_t i = 0; i < programs.size(); i++) {
+		if (programs[i] == program) {
+			programs.erase(programs.begin() + i);
+			break;
+		}
+	}
+	cancelPending(program);
+	if (program->id != fallback) glDeleteProgram(program->id);
+	delete program;
+
+	if (programs.empty() && fallback != 0) {
+		glDeleteProgram(fallback);
+		fallback = 0;
+	}
+}
+
+ProgramCacheStats getProgramCacheStats()
+{
+	stats.live = (int)programs.size();
+	stats.pending = 0;
+	for (size_t i = 0; i < programs.size(); i++) {
+		if (programs[i]->pending != 0) stats.pending++;
+	}
+	return stats;
+}
+
+void reportUniform(ShaderProgram * program, UniformId uniform, GLenum type)
+{
+	if (program->reported & (1u << uniform)) {
+		return;
+	}
+	program->reported |= 1u << uniform;
+	if (program->uniforms[uniform].location < 0) {
+		fprintf(stderr, "Uniform %s is set but not declared (or optimised out) by %s\n", uniformNames[uniform], program->name.c_str());
+	}
+	else {
+		fprintf(stderr, "Uniform %s of %s is set as type 0x%x but declared as 0x%x\n", uniformNames[uniform], program->name.c_str(), type, program->uniforms[uniform].type);
+	}
+}
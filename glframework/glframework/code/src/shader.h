@@ -0,0 +1,124 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <GL\glew.h>
+#include <glm\gtc\type_ptr.hpp>
+
+GLuint compileShader(GLenum shaderType, std::string shaderName, const char* name = "");
+void linkProgram(GLuint program);
+
+// Uniforms the renderer feeds, resolved once per program when it is linked
+// (camera, lights and material live in the FrameData block instead)
+enum UniformId {
+	U_objMat,
+	U_pos_Offset,
+	U_pos_Scale,
+	U_color,
+	U_draw_Offset,
+	U_draw_Count,
+	U_draw_Split,
+	UniformCount
+};
+
+extern const char * const uniformNames[UniformCount];
+
+// Binding point of the std140 FrameData uniform block, written once per frame by the
+// renderer. Every program declaring the block is pointed at it when it is created.
+const GLuint frameDataBinding = 0;
+
+// Location and GL type of an active uniform, -1 when the program does not declare it
+struct UniformSlot {
+	GLint location;
+	GLenum type;
+};
+
+// Linked program shared by everyone asking for the same sources and attribute bindings.
+struct ShaderProgram {
+	GLuint id;
+	unsigned long long key;	// of the sources as first acquired, kept across reloads
+	int refs;
+	std::string name;
+	std::string vertexPath, fragmentPath;	// fragmentPath is empty for compute programs
+	std::string defines;
+	std::vector< std::string > attributes;
+	std::vector< std::string > files;	// both sources and everything they include
+	unsigned long long binaryKey;	// 0 when program binaries are unavailable
+	GLuint pending;	// program still being compiled by the driver, id is the fallback meanwhile
+	bool linked;	// id is this program's own code, false while or after falling back
+	GLuint pendingShaders[2];
+	UniformSlot uniforms[UniformCount];
+	unsigned int reported;	// debug reports already printed, one bit per UniformId
+};
+
+// Debug mode: setting a uniform the program does not declare (or that the compiler dropped
+// as unused), or with the wrong type, is reported once per program and uniform. On by
+// default in debug builds.
+extern bool uniformDebug;
+void reportUniform(ShaderProgram * program, UniformId uniform, GLenum type);
+
+inline bool checkUniform(ShaderProgram * program, UniformId uniform, GLenum type) {
+	const UniformSlot & slot = program->uniforms[uniform];
+	if (slot.location >= 0 && (!uniformDebug || slot.type == type)) return true;
+	if (uniformDebug) reportUniform(program, uniform, type);
+	return false;
+}
+
+inline void setUniform(ShaderProgram * program, UniformId uniform, int value) {
+	if (checkUniform(program, uniform, GL_INT)) glUniform1i(program->uniforms[uniform].location, value);
+}
+inline void setUniform(ShaderProgram * program, UniformId uniform, float value) {
+	if (checkUniform(program, uniform, GL_FLOAT)) glUniform1f(program->uniforms[uniform].location, value);
+}
+inline void setUniform(ShaderProgram * program, UniformId uniform, const glm::vec3 & value) {
+	if (checkUniform(program, uniform, GL_FLOAT_VEC3)) glUniform3f(program->uniforms[uniform].location, value.x, value.y, value.z);
+}
+inline void setUniform(ShaderProgram * program, UniformId uniform, const glm::vec4 & value) {
+	if (checkUniform(program, uniform, GL_FLOAT_VEC4)) glUniform4f(program->uniforms[uniform].location, value.x, value.y, value.z, value.w);
+}
+inline void setUniform(ShaderProgram * program, UniformId uniform, const glm::mat4 & value) {
+	if (checkUniform(program, uniform, GL_FLOAT_MAT4)) glUniformMatrix4fv(program->uniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+// Returns the program for vertexPath + fragmentPath with attributes[i] bound to location i,
+// compiling and linking it only if no live program has the same key (a hash of both sources
+// and the bindings). Every acquire is paired with a releaseProgram.
+// Linked programs are also kept as driver binaries in programCacheDir, keyed on the program
+// key plus GL vendor, renderer and version, and reloaded from there on later runs whenever
+// the driver accepts them (GL_ARB_get_program_binary).
+// Sources go through a small preprocessor first: #include "file" is expanded, and defines
+// ("NAME" or "NAME=value", space separated) selects a permutation of them, so every variant
+// is its own program with its own key.
+ShaderProgram * acquireProgram(const char * vertexPath, const char * fragmentPath, const char * const * attributes, int attributeCount, const char * defines = "");
+
+// Batch compile: same as acquireProgram, but compile and link are only submitted and it
+// returns at once. Until updatePendingPrograms swaps the real program in, id is a flat colour
+// fallback (as it stays if compiling fails), linked telling the two apart. Submitting every
+// program before polling any lets the driver compile them in parallel
+// (GL_ARB_parallel_shader_compile).
+ShaderProgram * acquireProgramAsync(const char * vertexPath, const char * fragmentPath, const char * const * attributes, int attributeCount, const char * defines = "");
+// Compute shader programs (GL 4.3), through the same cache and pending path. vertexPath holds
+// the compute source and fragmentPath is empty. Until linked, id is the fallback and must
+// not be dispatched.
+ShaderProgram * acquireComputeProgramAsync(const char * computePath, const char * defines = "");
+// Swaps in the programs the driver has finished, without waiting when the extension is there
+// (otherwise one per call). Returns how many are still compiling.
+int updatePendingPrograms();
+
+// Hot reload: recompiles, through the same pending path, every program whose loose source
+// files changed on disk since the last call. The old program keeps being drawn until the new
+// one links, and for good if it does not.
+void reloadChangedPrograms();
+void releaseProgram(ShaderProgram * program);
+
+const char * const programCacheDir = "shadercache";
+
+struct ProgramCacheStats {
+	int acquired;	// acquireProgram calls
+	int linked;	// programs created, from source or binary
+	int binaryHits;	// of those, loaded from the binary cache
+	int reloads;	// recompiles after a source file changed
+	int live;	// distinct programs alive now
+	int pending;	// of those, still compiling
+	double seconds;	// time spent creating programs
+};
+ProgramCacheStats getProgramCacheStats();
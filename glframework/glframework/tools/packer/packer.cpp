@@ -0,0 +1,97 @@
+// Builds assets.pack from the shader sources (*.txt) and meshes (*.obj) of a directory.
+// Meshes are stored already converted to the .meshbin layout, so the game maps them as is.
+//
+//     packer <asset directory> <output pack>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "filemap.h"
+#include "hash.h"
+#include "meshcache.h"
+#include "objloader.h"
+#include "pack.h"
+
+namespace {
+	bool hasExtension(const std::string & name, const char * extension) {
+		size_t length = strlen(extension);
+		return name.size() > length && name.compare(name.size() - length, length, extension) == 0;
+	}
+
+	void listFiles(const std::string & directory, std::vector< std::string > & names) {
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE) return;
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR * dir = opendir(directory.c_str());
+		if (dir == NULL) return;
+		while (dirent * entry = readdir(dir)) {
+			if (entry->d_type != DT_DIR) names.push_back(entry->d_name);
+		}
+		closedir(dir);
+#endif
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		printf("usage: %s <asset directory> <output pack>\n", argv[0]);
+		return 1;
+	}
+	std::string directory = argv[1];
+	std::vector< std::string > names;
+	listFiles(directory, names);
+	std::sort(names.begin(), names.end());
+
+	std::vector< PackSource > sources;
+	for (size_t i = 0; i < names.size(); i++) {
+		bool shader = hasExtension(names[i], ".txt");
+		bool mesh = hasExtension(names[i], ".obj");
+		if (!shader && !mesh) continue;
+
+		MappedFile file;
+		std::string path = directory + "/" + names[i];
+		if (!mapFile(path.c_str(), file)) {
+			printf("Could not read %s\n", path.c_str());
+			return 1;
+		}
+		PackSource source;
+		source.name = names[i];
+		statFile(path.c_str(), source.sourceSize, source.sourceModified);
+		if (shader) {
+			source.data.assign(file.data, file.data + file.size);
+		}
+		else {
+			ObjData obj;
+			if (!parseOBJ(file.data, file.size, obj, 0)) {
+				printf("Could not parse %s\n", path.c_str());
+				unmapFile(file);
+				return 1;
+			}
+			buildMeshBin(names[i].c_str(), obj, hashBytes(file.data, file.size), file.size, source.data);
+		}
+		unmapFile(file);
+		printf("%-24s %10u bytes\n", source.name.c_str(), (unsigned int)source.data.size());
+		sources.push_back(source);
+	}
+
+	if (!writePack(argv[2], sources)) {
+		printf("Could not write %s\n", argv[2]);
+		return 1;
+	}
+	printf("Wrote %d assets to %s\n", (int)sources.size(), argv[2]);
+	return 0;
+}